@@ -0,0 +1,100 @@
+#!/usr/bin/env python
+
+"""
+Compares the output of two amun runs on the same input, e.g. the fp32 CPU
+path against --cpu-int8:
+
+    amun -c config.yml --n-best < input > fp32.nbest
+    amun -c config.yml --n-best --cpu-int8 < input > int8.nbest
+    score_delta.py -r fp32.nbest -t int8.nbest
+
+Reports the BLEU of the test translations with the reference run as
+reference and, for n-best lists, the difference of the model scores of the
+best hypotheses. Exits with 1 if a threshold is exceeded.
+"""
+
+from __future__ import print_function, division
+
+import argparse
+import math
+import sys
+from collections import Counter
+
+
+def read_output(path):
+    """Returns a list of (translation, score or None) per sentence."""
+    best = {}
+    plain = []
+    with open(path) as f:
+        for line in f:
+            fields = line.rstrip("\n").split(" ||| ")
+            if len(fields) >= 4:
+                num = int(fields[0])
+                if num not in best:
+                    best[num] = (fields[1].strip(), float(fields[-1]))
+            else:
+                plain.append((line.strip(), None))
+    if best:
+        return [best[num] for num in sorted(best)]
+    return plain
+
+
+def bleu(hyps, refs, order=4):
+    matches = [0] * order
+    totals = [0] * order
+    hypLen = refLen = 0
+    for hyp, ref in zip(hyps, refs):
+        hyp, ref = hyp.split(), ref.split()
+        hypLen += len(hyp)
+        refLen += len(ref)
+        for n in range(1, order + 1):
+            hypNgrams = Counter(tuple(hyp[i:i + n]) for i in range(len(hyp) - n + 1))
+            refNgrams = Counter(tuple(ref[i:i + n]) for i in range(len(ref) - n + 1))
+            matches[n - 1] += sum((hypNgrams & refNgrams).values())
+            totals[n - 1] += max(len(hyp) - n + 1, 0)
+    if min(matches) == 0:
+        return 0.0
+    logPrec = sum(math.log(m / t) for m, t in zip(matches, totals)) / order
+    brevity = min(0.0, 1.0 - refLen / hypLen)
+    return 100.0 * math.exp(logPrec + brevity)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('-r', '--reference', required=True,
+                        help="Output of the reference run, e.g. fp32")
+    parser.add_argument('-t', '--test', required=True,
+                        help="Output of the run to check, e.g. int8")
+    parser.add_argument('--min-bleu', type=float, default=90.0,
+                        help="Minimal BLEU against the reference run")
+    parser.add_argument('--max-mean-delta', type=float, default=0.1,
+                        help="Maximal mean absolute score difference per word")
+    args = parser.parse_args()
+
+    ref = read_output(args.reference)
+    test = read_output(args.test)
+    if len(ref) != len(test):
+        sys.exit("Different number of sentences: {} vs {}".format(len(ref), len(test)))
+
+    ok = True
+    score = bleu([t for t, _ in test], [r for r, _ in ref])
+    same = sum(1 for (t, _), (r, _) in zip(test, ref) if t == r)
+    print("BLEU against reference: {:.2f}".format(score))
+    print("Identical translations: {}/{}".format(same, len(ref)))
+    ok &= score >= args.min_bleu
+
+    if ref and ref[0][1] is not None and test[0][1] is not None:
+        deltas = [abs(ts - rs) / max(len(rt.split()), 1)
+                  for (rt, rs), (_, ts) in zip(ref, test)]
+        mean = sum(deltas) / len(deltas)
+        print("Score delta per word: mean {:.4f}, max {:.4f}".format(mean, max(deltas)))
+        ok &= mean <= args.max_mean_delta
+
+    if not ok:
+        print("FAILED")
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
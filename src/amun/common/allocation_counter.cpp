@@ -0,0 +1,63 @@
+#include "common/allocation_counter.h"
+
+#ifdef ALLOCATION_COUNTER
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+thread_local size_t allocations = 0;
+
+}
+
+namespace amunmt {
+
+size_t ThreadAllocations() {
+  return allocations;
+}
+
+}
+
+// operator new[] and the sized and array deletes forward to these
+
+void* operator new(size_t size) {
+  ++allocations;
+  if (void* ptr = malloc(size ? size : 1)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  ++allocations;
+  return malloc(size ? size : 1);
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+  free(ptr);
+}
+
+// Blaze matrices, see -Wl,--wrap=posix_memalign in CMakeLists.txt
+extern "C" int __real_posix_memalign(void** ptr, size_t alignment, size_t size);
+
+extern "C" int __wrap_posix_memalign(void** ptr, size_t alignment, size_t size) {
+  ++allocations;
+  return __real_posix_memalign(ptr, alignment, size);
+}
+
+#else
+
+namespace amunmt {
+
+size_t ThreadAllocations() {
+  return 0;
+}
+
+}
+
+#endif
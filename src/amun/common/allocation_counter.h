@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+
+namespace amunmt {
+
+// Number of heap allocations the calling thread has made so far. Only counted
+// in builds configured with -DALLOCATION_COUNTER=ON, 0 otherwise.
+size_t ThreadAllocations();
+
+}
@@ -16,12 +16,15 @@ class BaseBestHyps
 
     BaseBestHyps(const BaseBestHyps&) = delete;
 
+    // isFirst for the first decoder step, where each sentence has a single
+    // row of probabilities however large its beam
     virtual void CalcBeam(
         const Beam& prevHyps,
         const std::vector<ScorerPtr>& scorers,
         const Words& filterIndices,
         std::vector<Beam>& beams,
-        std::vector<unsigned>& beamSizes) = 0;
+        std::vector<unsigned>& beamSizes,
+        bool isFirst) = 0;
 
   protected:
     const God &god_;
@@ -193,6 +193,8 @@ void Config::AddOptions(unsigned argc, char** argv) {
      "Overwrite bpe section in config with bpe code file.")
     ("no-debpe", po::value(&debpe)->zero_tokens()->default_value(false),
      "Providing bpe is on, turn off deBPE of the output.")
+    ("bpe-cache-size", po::value<unsigned>()->default_value(100000),
+     "Number of words whose BPE segmentation is kept, shared by all threads, 0 disables.")
 #ifdef CUDA
     ("devices,d", po::value(&devices)->multitoken()->default_value(std::vector<unsigned>(1, 0), "0"),
      "CUDA device(s) to use, set to 0 by default, "
@@ -212,6 +214,22 @@ void Config::AddOptions(unsigned argc, char** argv) {
      ("cpu-threads", po::value<unsigned>()->default_value(1),
       "Number of threads on the CPU.")
   #endif
+    ("cpu-int8", po::value<bool>()->zero_tokens()->default_value(false),
+     "Quantize the weights of nematus2 models to int8 for CPU decoding. "
+     "The int8 weights are built in every process, also from models converted by amun_model2bin.")
+    ("cpu-packed-weights", po::value<bool>()->zero_tokens()->default_value(false),
+     "Repack the weights of nematus2 models into aligned GEMM panels for CPU decoding. "
+     "The panels are built in every process, also from models converted by amun_model2bin.")
+    ("cpu-parallel-encoder", po::value<bool>()->zero_tokens()->default_value(false),
+     "Encode the backward direction as a subtask that idle CPU threads can take over.")
+    ("cpu-softmax-filter-cache", po::value<unsigned>()->default_value(256),
+     "Megabytes of output layers filtered by --softmax-filter kept per CPU model for repeated shortlists, 0 disables. "
+     "Each entry holds the output layer columns of one shortlist.")
+    ("cpu-vocab-shards", po::value<unsigned>()->default_value(1),
+     "Split the product of the output layer over this many subtasks that idle CPU threads can take over, 1 disables.")
+    ("cpu-vocab-major-output", po::value<bool>()->zero_tokens()->default_value(false),
+     "Keep a transposed copy of the output layer for faster --softmax-filter shortlists on the CPU, at the cost of its memory. "
+     "The copy is built in every process, also from models converted by amun_model2bin.")
 #endif
 
 #ifdef HAS_FPGA
@@ -229,6 +247,9 @@ void Config::AddOptions(unsigned argc, char** argv) {
       "Number of sentences in maxi batch.")
     ("mini-batch-words", po::value<int>()->default_value(0),
       "Set mini-batch size based on words instead of sentences.")
+    ("input-threads", po::value<unsigned>()->default_value(0),
+      "Number of threads that split, BPE-segment and look up input lines ahead of translation, "
+      "0 preprocesses them on the main thread.")
 
     ("use-fused-softmax", po::value<bool>()->default_value(true),
      "Use fused softmax/nth-element, if appropriate.")
@@ -270,7 +291,8 @@ void Config::AddOptions(unsigned argc, char** argv) {
     ("normalize,n", po::value<bool>()->zero_tokens()->default_value(false),
      "Normalize scores by translation length after decoding")
     ("softmax-filter,f", po::value<std::vector<std::string>>()->multitoken()->default_value(std::vector<std::string>(0), ""),
-     "Filter final softmax: path to file with alignment [N first words]")
+     "Filter final softmax: path to file with alignment [N first words] [max translations per word], "
+     "or to a binary shortlist converted by amun_lex2bin")
     ("allow-unk,u", po::value<bool>()->zero_tokens()->default_value(false),
      "Allow generation of UNK")
     ("n-best", po::value<bool>()->zero_tokens()->default_value(false),
@@ -332,6 +354,7 @@ void Config::AddOptions(unsigned argc, char** argv) {
   SET_OPTION("mini-batch", unsigned);
   SET_OPTION("maxi-batch", unsigned);
   SET_OPTION("mini-batch-words", int);
+  SET_OPTION("input-threads", unsigned);
 
   SET_OPTION("max-length", unsigned);
   SET_OPTION("max-length-multiple", float);
@@ -344,6 +367,12 @@ void Config::AddOptions(unsigned argc, char** argv) {
 #endif
 #ifdef HAS_CPU
   SET_OPTION("cpu-threads", unsigned);
+  SET_OPTION("cpu-int8", bool);
+  SET_OPTION("cpu-packed-weights", bool);
+  SET_OPTION("cpu-parallel-encoder", bool);
+  SET_OPTION("cpu-vocab-shards", unsigned);
+  SET_OPTION("cpu-softmax-filter-cache", unsigned);
+  SET_OPTION("cpu-vocab-major-output", bool);
 #endif
 #ifdef HAS_FPGA
   SET_OPTION("fpga-threads", unsigned);
@@ -11,6 +11,7 @@
 #include "common/printer.h"
 #include "common/sentence.h"
 #include "common/sentences.h"
+#include "common/sentence_reader.h"
 #include "common/exception.h"
 #include "common/translation_task.h"
 
@@ -29,35 +30,36 @@ int main(int argc, char* argv[])
   boost::timer::cpu_timer timer;
 
 
-  unsigned miniSize = (god.Get<unsigned>("cpu-threads") == 0) ? god.Get<unsigned>("mini-batch") : 1;
-  unsigned maxiSize = (god.Get<unsigned>("cpu-threads") == 0) ? god.Get<unsigned>("maxi-batch") : 1;
+  unsigned miniSize = god.Get<unsigned>("mini-batch");
+  unsigned maxiSize = god.Get<unsigned>("maxi-batch");
   int miniWords = god.Get<int>("mini-batch-words");
 
   LOG(info)->info("Reading input");
 
   SentencesPtr maxiBatch(new Sentences());
 
-  std::string line;
-  unsigned lineNum = 0;
+  SentenceReader reader(god, god.GetInputStream(), god.Get<unsigned>("input-threads"), maxiSize);
+  std::vector<SentencePtr> sentences;
 
-  while (std::getline(god.GetInputStream(), line)) {
-    maxiBatch->push_back(SentencePtr(new Sentence(god, lineNum++, line)));
+  while (reader.Next(sentences)) {
+    for (auto& sentence : sentences) {
+      maxiBatch->push_back(sentence);
 
-    if (maxiBatch->size() >= maxiSize) {
+      if (maxiBatch->size() >= maxiSize) {
 
-      maxiBatch->SortByLength();
-      while (maxiBatch->size()) {
-        SentencesPtr miniBatch = maxiBatch->NextMiniBatch(miniSize, miniWords);
-        //cerr << "miniBatch=" << miniBatch->size() << " maxiBatch=" << maxiBatch->size() << endl;
+        maxiBatch->SortByLength();
+        while (maxiBatch->size()) {
+          SentencesPtr miniBatch = maxiBatch->NextMiniBatch(miniSize, miniWords);
+          //cerr << "miniBatch=" << miniBatch->size() << " maxiBatch=" << maxiBatch->size() << endl;
 
-        god.GetThreadPool().enqueue(
-            [&god,miniBatch]{ return TranslationTaskAndOutput(god, miniBatch); }
-            );
-      }
+          god.GetThreadPool().enqueue(
+              [&god,miniBatch]{ return TranslationTaskAndOutput(god, miniBatch); }
+              );
+        }
 
-      maxiBatch.reset(new Sentences());
+        maxiBatch.reset(new Sentences());
+      }
     }
-
   }
 
   // last batch
@@ -5,14 +5,16 @@
 #include <fstream>
 #include <iostream>
 #include <memory>
-#include <set>
 #include <cmath>
+#include <cstring>
 #include <algorithm>
+#include <numeric>
 
-#include "common/god.h"
+#include "common/logging.h"
 #include "common/vocab.h"
 #include "common/utils.h"
 #include "common/types.h"
+#include "common/exception.h"
 
 using namespace std;
 
@@ -25,19 +27,93 @@ Filter::Filter(const Vocab& srcVocab,
                const std::string& path,
                const unsigned numFirstWords,
                const unsigned maxNumTranslation)
-  : numFirstWords_(numFirstWords),
-    mapper_(ParseAlignmentFile(srcVocab,
-                               trgVocab,
-                               path,
-                               maxNumTranslation,
-                               numFirstWords)) {}
-
-std::vector<Words> Filter::ParseAlignmentFile(const Vocab& srcVocab,
-                                              const Vocab& trgVocab,
-                                              const std::string& path,
-                                              const unsigned maxNumTranslation,
-                                              const unsigned numNFirst) {
-  std::map<Word, std::vector<std::pair<Word, float>>> mapper;
+  : numFirstWords_(numFirstWords)
+{
+  ParseAlignmentFile(srcVocab, trgVocab, path, maxNumTranslation, numFirstWords);
+}
+
+const char Filter::MAGIC[8] = {'A', 'M', 'U', 'N', 'L', 'E', 'X', '\0'};
+const uint32_t Filter::VERSION;
+
+Filter::Filter(const Vocab& srcVocab,
+               const Vocab& trgVocab,
+               const MappedFilePtr& binary)
+  : binary_(binary)
+{
+  const std::string& path = binary->path();
+  amunmt_UTIL_THROW_IF2(!IsBinary(path), "File " << path << " is not a binary shortlist");
+
+  BinaryHeader header;
+  amunmt_UTIL_THROW_IF2(binary->size() < sizeof(header), "Binary shortlist " << path << " is truncated");
+  std::memcpy(&header, binary->data(), sizeof(header));
+  amunmt_UTIL_THROW_IF2(header.version != VERSION,
+                        "Binary shortlist " << path << " has version " << header.version
+                        << ", expected " << VERSION);
+  amunmt_UTIL_THROW_IF2(header.srcVocabSize != srcVocab.size()
+                        || header.trgVocabSize != trgVocab.size(),
+                        "Binary shortlist " << path << " was built for vocabularies of "
+                        << header.srcVocabSize << " and " << header.trgVocabSize
+                        << " words, not " << srcVocab.size() << " and " << trgVocab.size());
+
+  size_t size = sizeof(header)
+              + (header.srcVocabSize + 1) * sizeof(uint32_t)
+              + header.numTargets * sizeof(Word);
+  amunmt_UTIL_THROW_IF2(binary->size() != size,
+                        "Binary shortlist " << path << " has " << binary->size()
+                        << " bytes, expected " << size);
+
+  numFirstWords_ = header.numFirstWords;
+  maxNumTranslation_ = header.maxNumTranslation;
+  srcVocabSize_ = header.srcVocabSize;
+  trgVocabSize_ = header.trgVocabSize;
+  numTargets_ = header.numTargets;
+  offsets_ = reinterpret_cast<const uint32_t*>(binary->data() + sizeof(header));
+  targets_ = reinterpret_cast<const Word*>(offsets_ + srcVocabSize_ + 1);
+  amunmt_UTIL_THROW_IF2(offsets_[0] != 0 || offsets_[srcVocabSize_] != numTargets_,
+                        "Binary shortlist " << path << " is corrupt");
+  for (size_t i = 0; i < srcVocabSize_; ++i) {
+    amunmt_UTIL_THROW_IF2(offsets_[i] > offsets_[i + 1],
+                          "Binary shortlist " << path << " is corrupt");
+  }
+}
+
+bool Filter::IsBinary(const std::string& path) {
+  char magic[sizeof(MAGIC)];
+  std::ifstream file(path, std::ios::binary);
+  return file.read(magic, sizeof(magic)) && std::equal(magic, magic + sizeof(magic), MAGIC);
+}
+
+void Filter::Save(const std::string& path) const {
+  amunmt_UTIL_THROW_IF2(!offsets_, "No shortlist to save to " << path);
+
+  BinaryHeader header;
+  std::copy(MAGIC, MAGIC + sizeof(MAGIC), header.magic);
+  header.version = VERSION;
+  header.numFirstWords = numFirstWords_;
+  header.maxNumTranslation = maxNumTranslation_;
+  header.srcVocabSize = srcVocabSize_;
+  header.trgVocabSize = trgVocabSize_;
+  header.numTargets = numTargets_;
+
+  std::ofstream file(path, std::ios::binary);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(offsets_), (srcVocabSize_ + 1) * sizeof(uint32_t));
+  file.write(reinterpret_cast<const char*>(targets_), numTargets_ * sizeof(Word));
+  amunmt_UTIL_THROW_IF2(!file, "Cannot write " << path);
+}
+
+void Filter::ParseAlignmentFile(const Vocab& srcVocab,
+                                const Vocab& trgVocab,
+                                const std::string& path,
+                                const unsigned maxNumTranslation,
+                                const unsigned numNFirst) {
+  struct Entry {
+    Word src;
+    Word trg;
+    float prob;
+  };
+  std::vector<Entry> entries;
+
   std::ifstream filterFile(path);
   std::string line;
   std::string delimiter = "";
@@ -65,59 +141,56 @@ std::vector<Words> Filter::ParseAlignmentFile(const Vocab& srcVocab,
       continue;
     }
     if (trgVocab[tokens[trgIndex]] != 1 && srcVocab[tokens[srcIndex]] != 1) {
-      mapper[srcVocab[tokens[1]]].push_back(std::make_pair(trgVocab[tokens[trgIndex]],
-                                                           std::stof(tokens[2])));
+      entries.push_back({srcVocab[tokens[1]], trgVocab[tokens[trgIndex]], std::stof(tokens[2])});
     }
   }
-  std::vector<Words> vecMapper(srcVocab.size());
+
+  // bucket the entries by source word, keeping the order of the file
+  std::vector<unsigned> begin(srcVocab.size() + 1, 0);
+  for (const auto& entry : entries) {
+    ++begin[entry.src + 1];
+  }
+  std::partial_sum(begin.begin(), begin.end(), begin.begin());
+
+  std::vector<std::pair<Word, float>> translations(entries.size());
+  std::vector<unsigned> next(begin.begin(), begin.end() - 1);
+  for (const auto& entry : entries) {
+    translations[next[entry.src]++] = std::make_pair(entry.trg, entry.prob);
+  }
+
+  parsedOffsets_.assign(srcVocab.size() + 1, 0);
+  parsedTargets_.clear();
   for (unsigned i = 0; i < srcVocab.size(); ++i) {
-    if (mapper.find(i) != mapper.end()) {
-      std::sort(mapper[i].begin(), mapper[i].end(),
-          [](const std::pair<Word, float>& left,
-            const std::pair<Word, float>& right) {
-            return left.second > right.second; });
-      for (unsigned j = 0; j < std::min((unsigned) mapper[i].size(), maxNumTranslation); ++j) {
-        if (mapper[i][j].first >= numNFirst) {
-          vecMapper[i].push_back(mapper[i][j].first);
-        }
+    auto first = translations.begin() + begin[i];
+    auto last = translations.begin() + begin[i + 1];
+    std::sort(first, last,
+        [](const std::pair<Word, float>& left,
+          const std::pair<Word, float>& right) {
+          return left.second > right.second; });
+    for (unsigned j = 0; j < std::min((unsigned) (last - first), maxNumTranslation); ++j) {
+      if (first[j].first >= numNFirst) {
+        parsedTargets_.push_back(first[j].first);
       }
-      // std::cerr << "MAP :" << i  << " " << srcVocab[i] << " " << vecMapper[i].size()
-                // <<  " " << mapper[i].size() << std::endl;
     }
+    parsedOffsets_[i + 1] = parsedTargets_.size();
   }
-  return vecMapper;
-}
 
-// Words Filter::GetFilteredVocab(const Words& srcWords, const unsigned maxVocabSize) const {
-  // std::set<Word> filtered;
-
-  // for(unsigned i = 0; i < std::min(numFirstWords_, maxVocabSize); ++i) {
-    // filtered.insert(i);
-  // }
-
-  // for (const auto& srcWord : srcWords) {
-    // unsigned licz = 0;
-    // for (const auto& trgWord : mapper_[srcWord]) {
-      // if (trgWord < maxVocabSize) {
-        // ++licz;
-      // }
-    // }
-    // for (const auto& trgWord : mapper_[srcWord]) {
-      // if (trgWord < maxVocabSize) {
-        // filtered.insert(trgWord);
-      // }
-    // }
-  // }
-
-  // Words output(filtered.begin(), filtered.end());
-
-  // return output;
-// }
+  maxNumTranslation_ = maxNumTranslation;
+  srcVocabSize_ = srcVocab.size();
+  trgVocabSize_ = trgVocab.size();
+  offsets_ = parsedOffsets_.data();
+  targets_ = parsedTargets_.data();
+  numTargets_ = parsedTargets_.size();
+}
 
 unsigned Filter::GetNumFirstWords() const {
   return numFirstWords_;
 }
 
+unsigned Filter::GetMaxNumTranslation() const {
+  return maxNumTranslation_;
+}
+
 void Filter::SetNumFirstWords(const unsigned numFirstWords) {
   numFirstWords_ = numFirstWords;
 }
@@ -1,11 +1,13 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
 #include <string>
 #include <memory>
-#include <unordered_set>
-#include <set>
+#include <vector>
 
 #include "common/types.h"
+#include "common/mapped_file.h"
 
 namespace amunmt {
 
@@ -21,40 +23,97 @@ class Filter {
            const unsigned numFirstWords=10000,
            const unsigned maxNumTranslation=1000);
 
-    template<class T>
-    Words GetFilteredVocab(const T& srcWords, const unsigned maxVocabSize) const {
-      std::set<Word> filtered;
+    // shortlist written by Save, mapped into memory instead of parsed
+    Filter(const Vocab& srcVocab,
+           const Vocab& trgVocab,
+           const MappedFilePtr& binary);
+
+    Filter(const Filter&) = delete;
 
-      for(unsigned i = 0; i < std::min(numFirstWords_, maxVocabSize); ++i) {
-        filtered.insert(i);
+    // whether path starts like a shortlist written by Save
+    static bool IsBinary(const std::string& path);
+
+    // writes the sorted and truncated table, for the same vocabularies only
+    void Save(const std::string& path) const;
+
+    // Sorted ids of the first numFirstWords_ target words and of the
+    // translations of srcWords, all below maxVocabSize. marks is a bitset of
+    // the caller which is left cleared, so that it can be reused by the next
+    // batch without allocating.
+    template<class T>
+    void GetFilteredVocab(const T& srcWords, const unsigned maxVocabSize,
+                          std::vector<uint64_t>& marks, Words& output) const {
+      const unsigned numFirstWords = std::min(numFirstWords_, maxVocabSize);
+      const unsigned numMarks = (maxVocabSize + 63) / 64;
+      if (marks.size() < numMarks) {
+        marks.resize(numMarks, 0);
       }
 
       for (const auto& srcWord : srcWords) {
-        for (const auto& trgWord : mapper_[srcWord]) {
-          if (trgWord < maxVocabSize) {
-            filtered.insert(trgWord);
+        if (srcWord >= srcVocabSize_) {
+          continue;
+        }
+        for (unsigned i = offsets_[srcWord]; i < offsets_[srcWord + 1]; ++i) {
+          const Word trgWord = targets_[i];
+          if (trgWord >= numFirstWords && trgWord < maxVocabSize) {
+            marks[trgWord / 64] |= uint64_t(1) << (trgWord % 64);
           }
         }
       }
 
-      Words output(filtered.begin(), filtered.end());
-
-      return output;
+      output.clear();
+      for (unsigned i = 0; i < numFirstWords; ++i) {
+        output.push_back(i);
+      }
+      for (unsigned i = numFirstWords / 64; i < numMarks; ++i) {
+        for (uint64_t bits = marks[i]; bits; bits &= bits - 1) {
+          output.push_back(i * 64 + __builtin_ctzll(bits));
+        }
+        marks[i] = 0;
+      }
     }
 
     unsigned GetNumFirstWords() const;
 
-    void SetNumFirstWords(unsigned numFirstWords);
+    unsigned GetMaxNumTranslation() const;
 
-    static std::vector<Words> ParseAlignmentFile(const Vocab& srcVocab,
-                                                 const Vocab& trgVocab,
-                                                 const std::string& path,
-                                                 const unsigned maxNumTranslation,
-                                                 const unsigned numNFirst);
+    void SetNumFirstWords(unsigned numFirstWords);
 
   private:
+    void ParseAlignmentFile(const Vocab& srcVocab,
+                            const Vocab& trgVocab,
+                            const std::string& path,
+                            const unsigned maxNumTranslation,
+                            const unsigned numNFirst);
+
+    struct BinaryHeader {
+      char magic[8];
+      uint32_t version;
+      uint32_t numFirstWords;
+      uint32_t maxNumTranslation;
+      uint32_t srcVocabSize;
+      uint32_t trgVocabSize;
+      uint32_t numTargets;
+    };
+
+    static const char MAGIC[8];
+    static const uint32_t VERSION = 1;
+
     unsigned numFirstWords_;
-    const std::vector<Words> mapper_;
+    unsigned maxNumTranslation_ = 0;
+    unsigned srcVocabSize_ = 0;
+    unsigned trgVocabSize_ = 0;
+
+    // translations of all source words in one array, those of word w are
+    // targets_[offsets_[w]] .. targets_[offsets_[w + 1] - 1]. They point
+    // either into the vectors below or into binary_.
+    const uint32_t* offsets_ = nullptr;
+    const Word* targets_ = nullptr;
+    unsigned numTargets_ = 0;
+
+    std::vector<uint32_t> parsedOffsets_;
+    Words parsedTargets_;
+    MappedFilePtr binary_;
 };
 
 typedef std::unique_ptr<Filter> FilterPtr;
@@ -1,3 +1,4 @@
+#include <future>
 #include <vector>
 #include <sstream>
 #include <boost/range/adaptor/map.hpp>
@@ -97,8 +98,9 @@ God& God::Init(int argc, char** argv) {
 
   if (Get<bool>("use-fused-softmax")) {
     useFusedSoftmax_ = true;
-    if (gpuLoaders_.size() != 1 || // more than 1 scorer
-        God::Get<unsigned>("beam-size") > 11 // beam size affect shared mem alloc in gLogSoftMax()
+    if (gpuLoaders_.size() > 1 || cpuLoaders_.size() > 1 || // more than 1 scorer
+        gpuLoaders_.size() + cpuLoaders_.size() == 0 ||
+        (gpuLoaders_.size() && God::Get<unsigned>("beam-size") > 11) // beam size affect shared mem alloc in gLogSoftMax()
         ) {
       useFusedSoftmax_ = false;
     }
@@ -156,9 +158,17 @@ void God::LoadScorers() {
 #ifdef HAS_CPU
   unsigned cpuThreads = God::Get<unsigned>("cpu-threads");
   if (cpuThreads) {
+    // the members of an ensemble are loaded concurrently
+    std::vector<std::pair<std::string, std::future<LoaderPtr>>> loading;
     for (auto&& pair : config_.Get()["scorers"]) {
       std::string name = pair.first.as<std::string>();
-      cpuLoaders_.emplace(name, LoaderFactory::Create(*this, name, pair.second, CPUDevice));
+      YAML::Node config = pair.second;
+      loading.emplace_back(name, std::async(std::launch::async, [this, name, config] {
+        return LoaderFactory::Create(*this, name, config, CPUDevice);
+      }));
+    }
+    for (auto& loader : loading) {
+      cpuLoaders_.emplace(loader.first, loader.second.get());
     }
   }
 #endif
@@ -178,9 +188,19 @@ void God::LoadFiltering() {
   if (!Get<std::vector<std::string>>("softmax-filter").empty()) {
     auto filterOptions = Get<std::vector<std::string>>("softmax-filter");
     std::string alignmentFile = filterOptions[0];
-    LOG(info)->info("Reading target softmax filter file from {}", alignmentFile);
     Filter* filter = nullptr;
-    if (filterOptions.size() >= 3) {
+    if (Filter::IsBinary(alignmentFile)) {
+      LOG(info)->info("Mapping binary softmax filter file {}", alignmentFile);
+      filter = new Filter(GetSourceVocab(0, 0),
+                          GetTargetVocab(),
+                          MappedFilePtr(new MappedFile(alignmentFile)));
+      if (filterOptions.size() >= 2) {
+        LOG(info)->warn("The binary softmax filter was built with {} first words and {} translations, "
+                        "ignoring the other --softmax-filter arguments",
+                        filter->GetNumFirstWords(), filter->GetMaxNumTranslation());
+      }
+    } else if (filterOptions.size() >= 3) {
+      LOG(info)->info("Reading target softmax filter file from {}", alignmentFile);
       const unsigned numNFirst = stoi(filterOptions[1]);
       const unsigned maxNumTranslation = stoi(filterOptions[2]);
       filter = new Filter(GetSourceVocab(0, 0),
@@ -189,12 +209,14 @@ void God::LoadFiltering() {
                           numNFirst,
                           maxNumTranslation);
     } else if (filterOptions.size() == 2) {
+      LOG(info)->info("Reading target softmax filter file from {}", alignmentFile);
       const unsigned numNFirst = stoi(filterOptions[1]);
       filter = new Filter(GetSourceVocab(0, 0),
                           GetTargetVocab(),
                           alignmentFile,
                           numNFirst);
     } else {
+      LOG(info)->info("Reading target softmax filter file from {}", alignmentFile);
       filter = new Filter(GetSourceVocab(0, 0),
                           GetTargetVocab(),
                           alignmentFile);
@@ -205,19 +227,20 @@ void God::LoadFiltering() {
 
 void God::LoadPrePostProcessing() {
   if (Has("bpe")) {
+    unsigned bpeCacheSize = Get<unsigned>("bpe-cache-size");
     if(Get("bpe").IsSequence()) {
       unsigned i = 0;
       for(auto bpePath : Get<std::vector<std::string>>("bpe")) {
         LOG(info)->info("using bpe: {}", bpePath);
         preprocessors_.push_back(std::vector<PreprocessorPtr>());
-        preprocessors_[i++].emplace_back(new BPE(bpePath));
+        preprocessors_[i++].emplace_back(new BPE(bpePath, "@@", bpeCacheSize));
       }
     }
     else {
       LOG(info)->info("using bpe: {}", Get<std::string>("bpe"));
         preprocessors_.push_back(std::vector<PreprocessorPtr>());
       if (Get<std::string>("bpe") != "") {
-        preprocessors_[0].emplace_back(new BPE(Get<std::string>("bpe")));
+        preprocessors_[0].emplace_back(new BPE(Get<std::string>("bpe"), "@@", bpeCacheSize));
       }
     }
   }
@@ -79,7 +79,7 @@ class God {
     Search &GetSearch() const;
 
     unsigned GetTotalThreads() const;
-    ThreadPool &GetThreadPool()
+    ThreadPool &GetThreadPool() const
     { return *pool_; }
 
     bool ReturnNBestList() const
@@ -30,7 +30,7 @@ class Histories {
     Beam GetFirstHyps() {
       Beam beam;
       for (auto& history : coll_) {
-        beam.emplace_back(history->front()[0]);
+        beam.emplace_back(history->GetFirstHyp());
       }
       return beam;
     }
@@ -6,22 +6,28 @@ using namespace std;
 namespace amunmt {
 
 History::History(const Sentence &sentence, bool normalizeScore, unsigned maxLength)
-  : normalize_(normalizeScore),
+  : first_(new Hypothesis(sentence)),
+    steps_(0),
+    normalize_(normalizeScore),
     lineNo_(sentence.GetLineNum()),
    maxLength_(maxLength)
 {
-  Add({HypothesisPtr(new Hypothesis(sentence))});
+  Add({first_});
 }
 
 void History::Add(const Beam& beam) {
-  if (beam.back()->GetPrevHyp() != nullptr) {
-    for (unsigned j = 0; j < beam.size(); ++j)
-      if(beam[j]->GetWord() == EOS_ID || size() == maxLength_ ) {
-        float cost = normalize_ ? beam[j]->GetCost() / history_.size() : beam[j]->GetCost();
-        topHyps_.push({ (unsigned)history_.size(), j, cost });
-      }
+  for (unsigned j = 0; j < beam.size(); ++j) {
+    const HypothesisPtr& hyp = beam[j];
+    SoftAlignmentPtr alignment = hyp->GetAlignments().empty() ? nullptr : hyp->GetAlignment(0);
+    hyp->SetTrellisIndex(trellis_.Add(hyp->GetWord(), hyp->GetPrevTrellisIndex(), hyp->GetCost(),
+                                      hyp->GetCostBreakdown(), alignment));
+
+    if (steps_ > 0 && (hyp->GetWord() == EOS_ID || steps_ == maxLength_)) {
+      float cost = normalize_ ? hyp->GetCost() / steps_ : hyp->GetCost();
+      topHyps_.push({ hyp->GetTrellisIndex(), cost });
+    }
   }
-  history_.push_back(beam);
+  ++steps_;
 }
 
 NBestList History::NBest(unsigned n) const
@@ -29,21 +35,11 @@ NBestList History::NBest(unsigned n) const
   NBestList nbest;
   auto topHypsCopy = topHyps_;
   while (nbest.size() < n && !topHypsCopy.empty()) {
-    auto bestHypCoord = topHypsCopy.top();
+    unsigned i = topHypsCopy.top().index;
     topHypsCopy.pop();
 
-    unsigned start = bestHypCoord.i;
-    unsigned j  = bestHypCoord.j;
-
-    Words targetWords;
-    HypothesisPtr bestHyp = history_[start][j];
-    while(bestHyp->GetPrevHyp() != nullptr) {
-      targetWords.push_back(bestHyp->GetWord());
-      bestHyp = bestHyp->GetPrevHyp();
-    }
-
-    std::reverse(targetWords.begin(), targetWords.end());
-    nbest.emplace_back(targetWords, history_[bestHypCoord.i][bestHypCoord.j]);
+    nbest.push_back({ trellis_.GetWords(i), trellis_.GetCost(i),
+                      trellis_.GetCostBreakdown(i), trellis_.GetAlignments(i) });
   }
   return nbest;
 }
@@ -5,11 +5,24 @@
 
 #include "hypothesis.h"
 #include "beam.h"
+#include "trellis.h"
 
 namespace amunmt {
 
 class Sentences;
 
+// A finished translation, read back from the Trellis
+struct Result {
+  Words words;
+  float cost;
+  std::vector<float> costBreakdown;
+
+  // alignments of the first scorer in the order of words
+  std::vector<SoftAlignmentPtr> alignments;
+};
+
+typedef std::vector<Result> NBestList;
+
 class History {
   private:
     struct HypothesisCoord {
@@ -17,8 +30,7 @@ class History {
         return cost < hc.cost;
       }
 
-      unsigned i;
-      unsigned j;
+      unsigned index;
       float cost;
     };
 
@@ -29,12 +41,13 @@ class History {
 
     void Add(const Beam& beam);
 
+    // number of steps, including the empty first hypothesis
     unsigned size() const {
-      return history_.size();
+      return steps_;
     }
 
-    Beam& front() {
-      return history_.front();
+    HypothesisPtr GetFirstHyp() const {
+      return first_;
     }
 
     NBestList NBest(unsigned n) const;
@@ -53,7 +66,9 @@ class History {
     bool GetActive() const;
 
   private:
-    std::vector<Beam> history_;
+    HypothesisPtr first_;
+    Trellis trellis_;
+    unsigned steps_;
     std::priority_queue<HypothesisCoord> topHyps_;
     bool normalize_;
     unsigned lineNo_;
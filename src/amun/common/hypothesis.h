@@ -3,6 +3,7 @@
 #include <cassert>
 #include "common/types.h"
 #include "common/soft_alignment.h"
+#include "common/trellis.h"
 
 namespace amunmt {
 
@@ -11,38 +12,36 @@ class Sentence;
 
 typedef std::shared_ptr<Hypothesis> HypothesisPtr;
 
+// A candidate of one decoder step. Hypotheses only live as long as the beam
+// they are in, finished translations are read back from the Trellis of their
+// History, see History::Add().
 class Hypothesis {
   public:
     Hypothesis(const Sentence &sentence)
     : sentence_(sentence),
-       prevHyp_(nullptr),
-       prevIndex_(0),
-       word_(0),
-       cost_(0.0)
+      prevIndex_(0),
+      word_(0),
+      cost_(0.0)
     {}
 
-    Hypothesis(const HypothesisPtr prevHyp, unsigned word, unsigned prevIndex, float cost)
+    Hypothesis(const HypothesisPtr& prevHyp, unsigned word, unsigned prevIndex, float cost)
     : sentence_(prevHyp->sentence_),
-      prevHyp_(prevHyp),
       prevIndex_(prevIndex),
+      prevTrellisIndex_(prevHyp->trellisIndex_),
       word_(word),
       cost_(cost)
     {}
 
-    Hypothesis(const HypothesisPtr prevHyp, unsigned word, unsigned prevIndex, float cost,
+    Hypothesis(const HypothesisPtr& prevHyp, unsigned word, unsigned prevIndex, float cost,
                std::vector<SoftAlignmentPtr> alignment)
     : sentence_(prevHyp->sentence_),
-      prevHyp_(prevHyp),
       prevIndex_(prevIndex),
+      prevTrellisIndex_(prevHyp->trellisIndex_),
       word_(word),
       cost_(cost),
       alignments_(alignment)
     {}
 
-    const HypothesisPtr GetPrevHyp() const {
-      return prevHyp_;
-    }
-
     unsigned GetWord() const {
       return word_;
     }
@@ -68,10 +67,25 @@ class Hypothesis {
       return alignments_;
     }
 
+    // position in the Trellis of the sentence, set when the History adds it
+    unsigned GetTrellisIndex() const {
+      return trellisIndex_;
+    }
+
+    void SetTrellisIndex(unsigned i) {
+      trellisIndex_ = i;
+    }
+
+    // position of the predecessor, Trellis::NONE for the first hypothesis
+    unsigned GetPrevTrellisIndex() const {
+      return prevTrellisIndex_;
+    }
+
   private:
-    const HypothesisPtr prevHyp_;
     const Sentence &sentence_;
     const unsigned prevIndex_;
+    const unsigned prevTrellisIndex_ = Trellis::NONE;
+    unsigned trellisIndex_ = Trellis::NONE;
     const unsigned word_;
     const float cost_;
     std::vector<SoftAlignmentPtr> alignments_;
@@ -79,11 +93,4 @@ class Hypothesis {
     std::vector<float> costBreakdown_;
 };
 
-typedef std::pair<Words, HypothesisPtr> Result;
-typedef std::vector<Result> NBestList;
-
-////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-
 }
-
@@ -0,0 +1,37 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "common/filter.h"
+#include "common/logging.h"
+#include "common/vocab.h"
+
+using namespace amunmt;
+
+// Converts a lexical shortlist for --softmax-filter into the binary format,
+// which amun maps into memory instead of parsing and sorting it at startup.
+int main(int argc, char* argv[]) {
+  if (argc < 5 || argc > 7) {
+    std::cerr << "Usage: " << argv[0]
+              << " source-vocab target-vocab lex-file output [N first words] [max translations per word]"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  auto info = spdlog::stderr_logger_mt("info");
+  info->set_pattern("[%c] (%L) %v");
+
+  const unsigned numFirstWords = argc > 5 ? std::stoi(argv[5]) : 10000;
+  const unsigned maxNumTranslation = argc > 6 ? std::stoi(argv[6]) : 1000;
+
+  try {
+    Vocab srcVocab(argv[1]);
+    Vocab trgVocab(argv[2]);
+    Filter filter(srcVocab, trgVocab, argv[3], numFirstWords, maxNumTranslation);
+    filter.Save(argv[4]);
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
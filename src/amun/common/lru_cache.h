@@ -0,0 +1,133 @@
+#pragma once
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace amunmt {
+
+// Each value costs 1, capacity is a number of entries
+struct UnitCost {
+  template <class Value>
+  size_t operator()(const Value&) const {
+    return 1;
+  }
+};
+
+// Values computed from keys, shared by all threads. Entries are spread over
+// shards with a lock each, so that threads rarely wait for each other. A
+// shard drops its least recently used entries while their cost exceeds its
+// share of capacity. The cost of an entry is Cost()(value), e.g. its bytes.
+// A capacity of 0 disables the cache.
+template <class Key, class Value, class Hash = std::hash<Key>, class Cost = UnitCost>
+class LRUCache {
+  public:
+    typedef std::shared_ptr<const Value> ValuePtr;
+
+    explicit LRUCache(size_t capacity, size_t numShards = 1)
+      : capacity_(capacity),
+        shardCapacity_((capacity + numShards - 1) / numShards),
+        shards_(numShards)
+    {}
+
+    LRUCache(const LRUCache&) = delete;
+
+    // the cached value of key, or the one returned by compute()
+    template <class Compute>
+    ValuePtr Get(const Key& key, Compute compute) {
+      if (capacity_ == 0) {
+        return std::make_shared<const Value>(compute());
+      }
+      size_t hash = Hash()(key);
+      Shard& shard = shards_[hash % shards_.size()];
+      ValuePtr value = Find(shard, key);
+      if (!value) {
+        // computed without the lock, two threads may compute the same value
+        value = Insert(shard, key, std::make_shared<const Value>(compute()));
+      }
+      return value;
+    }
+
+    size_t Hits() const {
+      size_t hits = 0;
+      for (const Shard& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        hits += shard.hits;
+      }
+      return hits;
+    }
+
+    size_t Misses() const {
+      size_t misses = 0;
+      for (const Shard& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        misses += shard.misses;
+      }
+      return misses;
+    }
+
+  private:
+    struct Item {
+      Key key;
+      ValuePtr value;
+      size_t cost;
+    };
+    typedef std::list<Item> Items;
+
+    struct Shard {
+      mutable std::mutex mutex;
+
+      // most recently used first
+      Items items;
+      std::unordered_map<Key, typename Items::iterator, Hash> index;
+      size_t cost = 0;
+
+      size_t hits = 0;
+      size_t misses = 0;
+    };
+
+    ValuePtr Find(Shard& shard, const Key& key) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      auto it = shard.index.find(key);
+      if (it == shard.index.end()) {
+        ++shard.misses;
+        return nullptr;
+      }
+
+      ++shard.hits;
+      shard.items.splice(shard.items.begin(), shard.items, it->second);
+      return it->second->value;
+    }
+
+    ValuePtr Insert(Shard& shard, const Key& key, ValuePtr value) {
+      size_t cost = Cost()(*value);
+
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      auto it = shard.index.find(key);
+      if (it != shard.index.end()) {
+        // another thread was faster
+        return it->second->value;
+      }
+
+      shard.items.push_front({key, value, cost});
+      shard.index.emplace(key, shard.items.begin());
+      shard.cost += cost;
+
+      while (shard.cost > shardCapacity_) {
+        // users keep their own reference to a value that is still in use
+        shard.cost -= shard.items.back().cost;
+        shard.index.erase(shard.items.back().key);
+        shard.items.pop_back();
+      }
+      return value;
+    }
+
+    const size_t capacity_;
+    const size_t shardCapacity_;
+    std::vector<Shard> shards_;
+};
+
+}
@@ -0,0 +1,45 @@
+#include "common/mapped_file.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common/exception.h"
+
+namespace amunmt {
+
+MappedFile::MappedFile(const std::string& path)
+  : path_(path)
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  amunmt_UTIL_THROW_IF2(fd == -1, "Cannot open " << path << ": " << strerror(errno));
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    int error = errno;
+    close(fd);
+    amunmt_UTIL_THROW2("Cannot stat " << path << ": " << strerror(error));
+  }
+  size_ = st.st_size;
+
+  if (size_ > 0) {
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    int error = errno;
+    close(fd);
+    amunmt_UTIL_THROW_IF2(data == MAP_FAILED, "Cannot map " << path << ": " << strerror(error));
+    data_ = static_cast<const char*>(data);
+  } else {
+    close(fd);
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (data_) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+}
+
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace amunmt {
+
+// Read-only memory map of a whole file. The pages are shared with other
+// processes mapping the same file and are only read from disk when touched.
+class MappedFile {
+  public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const {
+      return data_;
+    }
+
+    size_t size() const {
+      return size_;
+    }
+
+    const std::string& path() const {
+      return path_;
+    }
+
+  private:
+    std::string path_;
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+typedef std::shared_ptr<const MappedFile> MappedFilePtr;
+
+}
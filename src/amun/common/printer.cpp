@@ -4,16 +4,15 @@ using namespace std;
 
 namespace amunmt {
 
-std::vector<unsigned> GetAlignment(const HypothesisPtr& hypothesis) {
+std::vector<unsigned> GetAlignment(const Result& result) {
+  // the alignment of the last word is left out
   std::vector<SoftAlignment> aligns;
-  HypothesisPtr last = hypothesis->GetPrevHyp();
-  while (last->GetPrevHyp().get() != nullptr) {
-    aligns.push_back(*(last->GetAlignment(0)));
-    last = last->GetPrevHyp();
+  for (unsigned i = 0; i + 1 < result.alignments.size(); ++i) {
+    aligns.push_back(*result.alignments[i]);
   }
 
   std::vector<unsigned> alignment;
-  for (auto it = aligns.rbegin(); it != aligns.rend(); ++it) {
+  for (auto it = aligns.begin(); it != aligns.end(); ++it) {
     unsigned maxArg = 0;
     for (unsigned i = 0; i < it->size(); ++i) {
       if ((*it)[maxArg] < (*it)[i]) {
@@ -36,17 +35,16 @@ std::string GetAlignmentString(const std::vector<unsigned>& alignment) {
   return alignString.str();
 }
 
-std::string GetSoftAlignmentString(const HypothesisPtr& hypothesis) {
+std::string GetSoftAlignmentString(const Result& result) {
+  // the alignment of the last word is left out
   std::vector<SoftAlignment> aligns;
-  HypothesisPtr last = hypothesis->GetPrevHyp();
-  while (last->GetPrevHyp().get() != nullptr) {
-    aligns.push_back(*(last->GetAlignment(0)));
-    last = last->GetPrevHyp();
+  for (unsigned i = 0; i + 1 < result.alignments.size(); ++i) {
+    aligns.push_back(*result.alignments[i]);
   }
 
   std::stringstream alignString;
   alignString << " |||";
-  for (auto it = aligns.rbegin(); it != aligns.rend(); ++it) {
+  for (auto it = aligns.begin(); it != aligns.end(); ++it) {
     alignString << " ";
     for (unsigned i = 0; i < it->size(); ++i) {
       if (i>0) alignString << ",";
@@ -63,22 +61,20 @@ std::string GetSoftAlignmentString(const HypothesisPtr& hypothesis) {
   return alignString.str();
 }
 
-std::string GetNematusAlignmentString(const HypothesisPtr& hypothesis, std::string best, std::string source, unsigned linenum) {
+std::string GetNematusAlignmentString(const Result& result, std::string best, std::string source, unsigned linenum) {
   std::vector<SoftAlignment> aligns;
-  HypothesisPtr last = hypothesis;
-  while (last->GetPrevHyp().get() != nullptr) {
-    aligns.push_back(*(last->GetAlignment(0)));
-    last = last->GetPrevHyp();
+  for (auto& alignment : result.alignments) {
+    aligns.push_back(*alignment);
   }
   //<Sentence Number> ||| <Translation> ||| 0 ||| <Source> ||| <Source word count> <Translation word count>
   std::stringstream firstline;
   int srcspaces = std::count_if(source.begin(), source.end(), [](unsigned char c){ return std::isspace(c); });
   
-  firstline << linenum << " ||| " << best << " ||| " << hypothesis->GetCost() / aligns.size() * -1 
+  firstline << linenum << " ||| " << best << " ||| " << result.cost / aligns.size() * -1 
   << " ||| " << source << " ||| " << srcspaces+2 << " " << aligns.size();
 
   std::stringstream alignString;
-  for (auto it = aligns.rbegin(); it != aligns.rend(); ++it) {
+  for (auto it = aligns.begin(); it != aligns.end(); ++it) {
     alignString << "\n";
     for (unsigned i = 0; i < srcspaces+2; ++i) {
       if (i>0) alignString << " ";
@@ -14,11 +14,11 @@
 
 namespace amunmt {
 
-std::vector<unsigned> GetAlignment(const HypothesisPtr& hypothesis);
+std::vector<unsigned> GetAlignment(const Result& result);
 
 std::string GetAlignmentString(const std::vector<unsigned>& alignment);
-std::string GetSoftAlignmentString(const HypothesisPtr& hypothesis);
-std::string GetNematusAlignmentString(const HypothesisPtr& hypothesis, std::string best, std::string source, unsigned linenum);
+std::string GetSoftAlignmentString(const Result& result);
+std::string GetNematusAlignmentString(const Result& result, std::string best, std::string source, unsigned linenum);
 
 template <class OStream>
 void Printer(const God &god, const History& history, OStream& out, const Sentence& sentence)
@@ -29,19 +29,19 @@ void Printer(const God &god, const History& history, OStream& out, const Sentenc
   }
 
   auto bestTranslation = history.Top();
-  std::vector<std::string> bestSentenceWords = god.Postprocess(god.GetTargetVocab()(bestTranslation.first));
+  std::vector<std::string> bestSentenceWords = god.Postprocess(god.GetTargetVocab()(bestTranslation.words));
 
   std::string best = Join(bestSentenceWords);
   if (god.Get<bool>("return-nematus-alignment")) {
 	//Get the source sentence for printing Nematus style soft alignments
 	std::string source = Join(god.Postprocess(god.GetSourceVocab()(sentence.GetWords(0))));
-    best = GetNematusAlignmentString(bestTranslation.second, best, source, history.GetLineNum());
+    best = GetNematusAlignmentString(bestTranslation, best, source, history.GetLineNum());
   }else{
     if (god.Get<bool>("return-alignment")) {
-      best += GetAlignmentString(GetAlignment(bestTranslation.second));
+      best += GetAlignmentString(GetAlignment(bestTranslation));
     }
     if (god.Get<bool>("return-soft-alignment")) {
-      best += GetSoftAlignmentString(bestTranslation.second);
+      best += GetSoftAlignmentString(bestTranslation);
     }
   }
 
@@ -53,31 +53,29 @@ void Printer(const God &god, const History& history, OStream& out, const Sentenc
     }
     for (unsigned i = 0; i < nbl.size(); ++i) {
       const Result& result = nbl[i];
-      const Words &words = result.first;
-      const HypothesisPtr &hypo = result.second;
+      const Words &words = result.words;
 
       if(god.Get<bool>("wipo")) {
         out << "OUT: ";
       }
       std::string translation = Join(god.Postprocess(god.GetTargetVocab()(words)));
       if (god.Get<bool>("return-alignment")) {
-        translation += GetAlignmentString(GetAlignment(hypo));
+        translation += GetAlignmentString(GetAlignment(result));
       }
       if (god.Get<bool>("return-soft-alignment")) {
-        translation += GetSoftAlignmentString(hypo);
+        translation += GetSoftAlignmentString(result);
       }
       out << history.GetLineNum() << " ||| " << translation << " |||";
 
-      //std::cerr << "hypo->GetCostBreakdown().size()=" << hypo->GetCostBreakdown().size() << std::endl;
-      for(unsigned j = 0; j < hypo->GetCostBreakdown().size(); ++j) {
-        out << " " << scorerNames[j] << "= " << std::setprecision(3) << std::fixed << hypo->GetCostBreakdown()[j];
+      for(unsigned j = 0; j < result.costBreakdown.size(); ++j) {
+        out << " " << scorerNames[j] << "= " << std::setprecision(3) << std::fixed << result.costBreakdown[j];
       }
 
       if(god.Get<bool>("normalize")) {
-        out << " ||| " << std::setprecision(3) << std::fixed << hypo->GetCost() / words.size();
+        out << " ||| " << std::setprecision(3) << std::fixed << result.cost / words.size();
       }
       else {
-        out << " ||| " << std::setprecision(3) << std::fixed << hypo->GetCost();
+        out << " ||| " << std::setprecision(3) << std::fixed << result.cost;
       }
 
       if(i < nbl.size() - 1)
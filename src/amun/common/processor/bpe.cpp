@@ -1,6 +1,8 @@
 #include "common/processor/bpe.h"
 
-#include <mutex>
+#include <cstring>
+#include <functional>
+#include <queue>
 #include <sstream>
 #include <iostream>
 
@@ -39,10 +41,10 @@ std::vector<std::string> BPE::Postprocess(const std::vector<std::string> input)
 }
 
 BPE::BPE()
-  : sep_("@@") {}
+  : sep_("@@"), cache_(0) {}
 
-BPE::BPE(std::ifstream&& file, const std::string sep)
-  : sep_(sep) {
+BPE::BPE(std::ifstream&& file, const std::string sep, size_t cacheSize)
+  : sep_(sep), cache_(cacheSize, CACHE_SHARDS) {
   std::string inputLine;
   size_t index = 0;
   bool firstLine = true;
@@ -55,12 +57,29 @@ BPE::BPE(std::ifstream&& file, const std::string sep)
     }
     std::vector<std::string> code;
     Split(inputLine, code);
-    bpeCodes_[make_pair(code[0], code[1])] = index++;
+    if (code.size() < 2) {
+      continue;
+    }
+    uint64_t pair = uint64_t(Intern(code[0])) << 32 | Intern(code[1]);
+    merges_[pair] = {uint32_t(index++), Intern(code[0] + code[1])};
   }
 }
 
-BPE::BPE(const std::string& path, const std::string sep)
-  : BPE(std::ifstream(path), sep) {}
+const uint32_t BPE::NO_SYMBOL;
+const size_t BPE::CACHE_SHARDS;
+
+uint32_t BPE::Intern(const std::string& symbol) {
+  return symbols_.emplace(symbol, symbols_.size()).first->second;
+}
+
+BPE::BPE(const std::string& path, const std::string sep, size_t cacheSize)
+  : BPE(std::ifstream(path), sep, cacheSize) {}
+
+BPE::~BPE() {
+  if (cache_.Hits() + cache_.Misses() > 0) {
+    LOG(info)->info("BPE cache: {} hits, {} misses", cache_.Hits(), cache_.Misses());
+  }
+}
 
 std::vector<std::string> BPE::Segment(const std::string& sentence) {
   std::vector<std::string> words, tokens;
@@ -97,85 +116,115 @@ void BPE::PrintSegment(const std::string& sentence) {
   }
 }
 
-std::set<BPE::BPEPair> BPE::GetPairs(const std::vector<std::string>& word) const {
-  std::set<BPE::BPEPair> pairSet;
-  for (size_t i = 1; i < word.size(); ++i) {
-    pairSet.emplace(word[i-1], word[i]);
-  }
-  return pairSet;
+std::vector<std::string> BPE::Encode(const std::string& word) const {
+  return *Lookup(word);
 }
 
-const BPE::BPEPair* BPE::FindBestBigram(const std::set<BPEPair>& pairs) const {
-  size_t minDist = bpeCodes_.size();
-  auto best = bpeCodes_.begin();
+SegmentationPtr BPE::Lookup(const std::string& word) const {
+  return cache_.Get(word, [&]() { return Apply(word); });
+}
 
-  for (const auto& pair : pairs) {
-    auto it = bpeCodes_.find(pair);
-    if (it == bpeCodes_.end()) {
-      continue;
-    }
-    if (it->second < minDist) {
-      minDist = it->second;
-      best = it;
+std::vector<std::string> BPE::Apply(const std::string& word) const {
+  // symbols of text, which are linked in order and span text[begin, end)
+  struct Symbol {
+    uint32_t id;
+    uint32_t begin;
+    uint32_t end;
+    int prev;
+    int next;
+  };
+
+  // an adjacent pair, stale once one of its symbols is merged
+  struct Candidate {
+    uint32_t rank;
+    int pos;
+    uint32_t left;
+    uint32_t right;
+    uint32_t merged;
+
+    bool operator>(const Candidate& other) const {
+      return rank > other.rank || (rank == other.rank && pos > other.pos);
     }
+  };
+
+  const std::string text = word.substr(0, strlen(word.c_str())) + "</w>";
+  const char* b = text.c_str();
+  const char* e = b + text.size() - 4;
+
+  std::vector<Symbol> symbols;
+  auto addSymbol = [&](uint32_t begin, uint32_t end) {
+    auto it = symbols_.find(text.substr(begin, end - begin));
+    int pos = symbols.size();
+    symbols.push_back({it != symbols_.end() ? it->second : NO_SYMBOL, begin, end, pos - 1, pos + 1});
+  };
+  while (b != e) {
+    uint32_t begin = b - text.c_str();
+    utf8::next(b, e);
+    addSymbol(begin, b - text.c_str());
   }
-  if (minDist == bpeCodes_.size()) {
-    return nullptr;
-  }
-  else {
-  return &(best->first);
-  }
-}
+  addSymbol(text.size() - 4, text.size());
+  symbols.back().next = -1;
 
-std::vector<std::string>& BPE::Encode(const std::string& word) const {
-  if (IsCached(word)) {
-    return cache_[word];
+  std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> candidates;
+  auto addCandidate = [&](int pos) {
+    if (pos < 0 || symbols[pos].next < 0) {
+      return;
+    }
+    uint32_t left = symbols[pos].id;
+    uint32_t right = symbols[symbols[pos].next].id;
+    if (left == NO_SYMBOL || right == NO_SYMBOL) {
+      return;
+    }
+    auto it = merges_.find(uint64_t(left) << 32 | right);
+    if (it != merges_.end()) {
+      candidates.push({it->second.rank, pos, left, right, it->second.merged});
+    }
+  };
+  for (int pos = 0; pos < (int)symbols.size(); ++pos) {
+    addCandidate(pos);
   }
 
-  std::vector<std::string> vWord = SplitWordIntoLetters(word);
-  vWord.push_back("</w>");
-
-  auto pairs = GetPairs(vWord);
-
-  while (true) {
-    const BPEPair* bigram = FindBestBigram(pairs);
-    if (bigram == nullptr) {
-      break;
+  std::vector<Candidate> round;
+  while (!candidates.empty()) {
+    // the pairs merged after this round have other ranks, even lower ones
+    // must wait for the next round
+    round.clear();
+    uint32_t rank = candidates.top().rank;
+    while (!candidates.empty() && candidates.top().rank == rank) {
+      round.push_back(candidates.top());
+      candidates.pop();
     }
 
-    std::vector<std::string> newWord;
-
-    auto it = vWord.begin();
-    while (it != vWord.end()) {
-      auto jt = std::find(it, vWord.end(), bigram->first);
-      for (auto i = it; i != jt; ++i) {
-        newWord.push_back(*i);
-      }
-
-      if (jt == vWord.end()) {
-        break;
+    for (const Candidate& candidate : round) {
+      Symbol& left = symbols[candidate.pos];
+      if (left.id != candidate.left || left.next < 0 || symbols[left.next].id != candidate.right) {
+        continue;
       }
-      it = jt;
-
-      if (*it == bigram->first && (it+1) != vWord.end() && *(it+1) == bigram->second) {
-        newWord.emplace_back(bigram->first + bigram->second);
-        it += 2;
-      } else {
-        newWord.push_back(*it);
-        it += 1;
+      Symbol& right = symbols[left.next];
+      left.id = candidate.merged;
+      left.end = right.end;
+      left.next = right.next;
+      if (right.next >= 0) {
+        symbols[right.next].prev = candidate.pos;
       }
+      right.id = NO_SYMBOL;
+
+      addCandidate(left.prev);
+      addCandidate(candidate.pos);
     }
-    std::swap(vWord, newWord);
-    if (newWord.size() == 1) {
-      break;
-    } else {
-      pairs = GetPairs(vWord);
-    }
+  }
+
+  std::vector<std::string> vWord;
+  for (int pos = 0; pos >= 0; pos = symbols[pos].next) {
+    vWord.push_back(text.substr(symbols[pos].begin, symbols[pos].end - symbols[pos].begin));
   }
 
   if (vWord.back() == "</w>") {
     vWord.pop_back();
   }
+  if (vWord.empty()) {
+    return vWord;
+  }
 
   if (EndsWith(vWord.back(), "</w>")) {
     vWord.back().resize(vWord.back().size() - 4);
@@ -185,12 +234,7 @@ std::vector<std::string>& BPE::Encode(const std::string& word) const {
     vWord[i] = vWord[i] + sep_;
   }
 
-  std::mutex mtx;
-  mtx.lock();
-  cache_[word] = vWord;
-  mtx.unlock();
-
-  return cache_[word];
+  return vWord;
 }
 
 std::vector<bpeFactors> BPE::Encode(const std::vector<bpeFactors>& words) const {
@@ -199,8 +243,8 @@ std::vector<bpeFactors> BPE::Encode(const std::vector<bpeFactors>& words) const
   std::vector<std::vector<std::string>> result;
   for (const bpeFactors& factorlist : words) {
     std::string word = factorlist[0];
-    std::vector<std::string>& encoded = Encode(word);
-    for (const auto& bpePart : encoded)
+    SegmentationPtr encoded = Lookup(word);
+    for (const auto& bpePart : *encoded)
     {
       result.push_back(bpeFactors());
       bpeFactors& current = result.back();
@@ -214,33 +258,13 @@ std::vector<bpeFactors> BPE::Encode(const std::vector<bpeFactors>& words) const
 std::vector<std::string> BPE::Encode(const std::vector<std::string>& words) const {
   std::vector<std::string> result;
   for (const auto& word : words) {
-    auto& encoded = Encode(word);
-    result.insert(result.end(), encoded.begin(), encoded.end());
+    SegmentationPtr encoded = Lookup(word);
+    result.insert(result.end(), encoded->begin(), encoded->end());
   }
   return result;
 }
 
 
-bool BPE::IsCached(const std::string& word) const {
-  return cache_.find(word) != cache_.end();
-}
-
-std::vector<std::string> BPE::SplitWordIntoLetters(const std::string& word) const {
-  char* charWord = (char*)word.c_str();
-  auto b = charWord;
-  auto e = charWord + strlen(charWord);
-
-  std::vector<std::string> letters;
-  int prevBegin = 0;
-  while (b != e) {
-    int end = utf8::next(b, e);
-    std::vector<unsigned char> utf8result;
-    utf8::utf32to8(&end,&end + 1, std::back_inserter(utf8result));
-    letters.emplace_back(utf8result.begin(), utf8result.end());
-  }
-  return letters;
-}
-
 bool BPE::EndsWith(std::string const &fullString, std::string const suffix) const {
   if (fullString.length() >= suffix.length()) {
     return (0 == fullString.compare(fullString.length() - suffix.length(), suffix.length(), suffix));
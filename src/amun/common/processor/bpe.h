@@ -1,54 +1,36 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
 #include <string>
 #include <fstream>
-#include <set>
+#include <memory>
 #include <unordered_map>
-#include <iterator>
 
 #include "common/processor/processor.h"
+#include "common/lru_cache.h"
 
 
-template<class T>
-inline void hash_combine(std::size_t & seed, const T & v)
-{
-  std::hash<T> hasher;
-  seed ^= hasher(v) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-}
-
-namespace std
-{
-  template<typename S, typename T> struct hash<pair<S, T>>
-  {
-      inline size_t operator()(const pair<S, T> & v) const
-      {
-            size_t seed = 0;
-            ::hash_combine(seed, v.first);
-            ::hash_combine(seed, v.second);
-            return seed;
-          }
-    };
-}
-
 namespace amunmt {
 
+typedef std::shared_ptr<const std::vector<std::string>> SegmentationPtr;
+
 typedef std::vector<std::string> bpeFactors;
 
 class BPE : public Processor {
-  using BPEPair = std::pair<std::string, std::string>;
-
   public:
     BPE();
-    BPE(std::ifstream&& file, const std::string sep = "@@");
 
-    BPE(const std::string& path, const std::string sep = "@@");
+    // cacheSize: number of words whose segmentation is kept, 0 disables
+    BPE(std::ifstream&& file, const std::string sep = "@@", size_t cacheSize = 0);
+
+    BPE(const std::string& path, const std::string sep = "@@", size_t cacheSize = 0);
 
     std::vector<std::string> Segment(const std::string& sentence);
 
     void PrintSegment(const std::string& sentence);
 
-    std::vector<std::string>& Encode(const std::string& word) const;
+    std::vector<std::string> Encode(const std::string& word) const;
 
     std::vector<bpeFactors> Encode(const std::vector<bpeFactors>& words) const;
     std::vector<std::string> Encode(const std::vector<std::string>& words) const;
@@ -57,21 +39,42 @@ class BPE : public Processor {
     std::vector<bpeFactors> Preprocess(const std::vector<bpeFactors> input) const;
     std::vector<std::string> Postprocess(const std::vector<std::string> input) const;
 
-    virtual ~BPE() {}
+    virtual ~BPE();
   private:
-    std::set<BPEPair> GetPairs(const std::vector<std::string>& word) const;
+    // the segmentation of word, through the cache
+    SegmentationPtr Lookup(const std::string& word) const;
 
-    const BPEPair* FindBestBigram(const std::set<BPEPair>& pairs) const;
+    // Applies the merges to the letters of word. Like the reference
+    // implementation, each round merges all occurrences of the adjacent pair
+    // of lowest rank from left to right, but the pairs are kept in a heap and
+    // the symbols in a linked list, so that a word of n letters takes
+    // O(n log n) instead of a scan of all pairs per round.
+    std::vector<std::string> Apply(const std::string& word) const;
 
-    bool IsCached(const std::string& word) const;
-
-    std::vector<std::string> SplitWordIntoLetters(const std::string& word) const;
+    uint32_t Intern(const std::string& symbol);
 
     bool EndsWith(const std::string& fullString, const std::string suffix) const;
 
-    std::unordered_map<BPEPair, size_t> bpeCodes_;
+    static const uint32_t NO_SYMBOL = UINT32_MAX;
+
+    // shards of cache_, so that threads rarely wait for each other
+    static const size_t CACHE_SHARDS = 16;
+
+    struct Merge {
+      uint32_t rank;
+      uint32_t merged;
+    };
+
+    // ids of all symbols of the codes
+    std::unordered_map<std::string, uint32_t> symbols_;
+
+    // the merge of each code, by the ids of its symbols left << 32 | right
+    std::unordered_map<uint64_t, Merge> merges_;
+
     const std::string sep_;
-    mutable std::unordered_map<std::string, std::vector<std::string>> cache_;
+    // segmentations of the most recently seen words, shared by all threads
+    // that preprocess input (--bpe-cache-size)
+    mutable LRUCache<std::string, std::vector<std::string>> cache_;
 
 
 };
@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <boost/timer/timer.hpp>
 #include "common/search.h"
+#include "common/allocation_counter.h"
 #include "common/sentences.h"
 #include "common/god.h"
 #include "common/history.h"
@@ -23,7 +25,9 @@ Search::Search(const God &god)
     maxBeamSize_(god.Get<unsigned>("beam-size")),
     maxLengthMult_(god.Get<float>("max-length-multiple")),
     normalizeScore_(god.Get<bool>("normalize")),
-    bestHyps_(god.GetBestHyps(deviceInfo_))
+    bestHyps_(god.GetBestHyps(deviceInfo_)),
+    states_(NewStates()),
+    nextStates_(NewStates())
 {
   //activeCount_.resize(god.Get<unsigned>("mini-batch") + 1, 0);
   BEGIN_TIMER_CPU("Search");
@@ -78,19 +82,27 @@ std::shared_ptr<Histories> Search::Translate(const Sentences& sentences) {
   }
 
 
-  States states = Encode(sentences);
-  States nextStates = NewStates();
+  Encode(sentences);
   std::vector<unsigned> beamSizes(sentences.size(), 1);
 
   std::shared_ptr<Histories> histories(new Histories(sentences, normalizeScore_, maxLengthMult_));
   Beam prevHyps = histories->GetFirstHyps();
 
+  // heap allocations of the decoder steps after the first, which sizes the
+  // scorers' buffers for this batch
+  size_t decodeAllocations = 0;
+  size_t beamAllocations = 0;
+
   for (unsigned decoderStep = 0; decoderStep < maxLengthMult_ * (float) sentences.GetMaxLength(); ++decoderStep) {
     //boost::timer::cpu_timer timerStep;
     //timerStep.start();
 
+    size_t allocations = ThreadAllocations();
     for (unsigned i = 0; i < scorers_.size(); i++) {
-      scorers_[i]->Decode(*states[i], *nextStates[i], beamSizes);
+      scorers_[i]->Decode(*states_[i], *nextStates_[i], beamSizes);
+    }
+    if (decoderStep > 0) {
+      decodeAllocations += ThreadAllocations() - allocations;
     }
 
     if (decoderStep == 0) {
@@ -100,7 +112,11 @@ std::shared_ptr<Histories> Search::Translate(const Sentences& sentences) {
     }
     //cerr << "beamSizes=" << Debug(beamSizes, 1) << endl;
 
-    bool hasSurvivors = CalcBeam(histories, beamSizes, prevHyps, states, nextStates, decoderStep);
+    allocations = ThreadAllocations();
+    bool hasSurvivors = CalcBeam(histories, beamSizes, prevHyps, states_, nextStates_, decoderStep);
+    if (decoderStep > 0) {
+      beamAllocations += ThreadAllocations() - allocations;
+    }
     if (!hasSurvivors) {
       break;
     }
@@ -115,18 +131,18 @@ std::shared_ptr<Histories> Search::Translate(const Sentences& sentences) {
   CleanAfterTranslation();
 
   LOG(progress)->info("Search took {}", timer.format(3, "%ws"));
+#ifdef ALLOCATION_COUNTER
+  LOG(progress)->info("Heap allocations after the first step: {} in Decode, {} in CalcBeam",
+                      decodeAllocations, beamAllocations);
+#endif
   return histories;
 }
 
-States Search::Encode(const Sentences& sentences) {
-  States states;
-  for (auto& scorer : scorers_) {
-    scorer->Encode(sentences);
-    auto state = scorer->NewState();
-    scorer->BeginSentenceState(*state, sentences.size());
-    states.emplace_back(state);
+void Search::Encode(const Sentences& sentences) {
+  for (unsigned i = 0; i < scorers_.size(); i++) {
+    scorers_[i]->Encode(sentences);
+    scorers_[i]->BeginSentenceState(*states_[i], sentences.size());
   }
-  return states;
 }
 
 bool Search::CalcBeam(
@@ -139,7 +155,7 @@ bool Search::CalcBeam(
 {
     unsigned batchSize = beamSizes.size();
     Beams beams(batchSize);
-    bestHyps_->CalcBeam(prevHyps, scorers_, filterIndices_, beams, beamSizes);
+    bestHyps_->CalcBeam(prevHyps, scorers_, filterIndices_, beams, beamSizes, decoderStep == 0);
     histories->Add(beams);
 
     //cerr << "batchSize=" << batchSize << endl;
@@ -185,15 +201,16 @@ States Search::NewStates() const {
 
 void Search::FilterTargetVocab(const Sentences& sentences) {
   unsigned vocabSize = scorers_[0]->GetVocabSize();
-  std::set<Word> srcWords;
+  filterSrcWords_.clear();
   for (unsigned i = 0; i < sentences.size(); ++i) {
-    const Sentence& sentence = sentences.Get(i);
-    for (const auto& srcWord : sentence.GetWords()) {
-      srcWords.insert(srcWord);
-    }
+    const Words& words = sentences.Get(i).GetWords();
+    filterSrcWords_.insert(filterSrcWords_.end(), words.begin(), words.end());
   }
+  std::sort(filterSrcWords_.begin(), filterSrcWords_.end());
+  filterSrcWords_.erase(std::unique(filterSrcWords_.begin(), filterSrcWords_.end()),
+                        filterSrcWords_.end());
 
-  filterIndices_ = filter_->GetFilteredVocab(srcWords, vocabSize);
+  filter_->GetFilteredVocab(filterSrcWords_, vocabSize, filterMarks_, filterIndices_);
   for (auto& scorer : scorers_) {
     scorer->Filter(filterIndices_);
   }
@@ -1,7 +1,8 @@
 #pragma once
 
 #include <memory>
-#include <set>
+#include <cstdint>
+#include <vector>
 
 #include "common/scorer.h"
 #include "common/sentence.h"
@@ -22,7 +23,7 @@ class Search {
   protected:
     States NewStates() const;
     void FilterTargetVocab(const Sentences& sentences);
-    States Encode(const Sentences& sentences);
+    void Encode(const Sentences& sentences);
     void CleanAfterTranslation();
 
     bool CalcBeam(
@@ -43,8 +44,17 @@ class Search {
     const float maxLengthMult_;
     bool normalizeScore_;
     Words filterIndices_;
+    // scratch space of FilterTargetVocab, kept across batches
+    Words filterSrcWords_;
+    std::vector<uint64_t> filterMarks_;
     BaseBestHypsPtr bestHyps_;
 
+    // Decode reads states_ and writes nextStates_, AssembleBeamState gathers
+    // the surviving rows back into states_. Both are kept for all batches of
+    // the thread, so their buffers keep their capacity.
+    States states_;
+    States nextStates_;
+
     //std::vector<unsigned> activeCount_;
     //void BatchStats();
 };
@@ -0,0 +1,85 @@
+#include "common/sentence_reader.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace amunmt {
+
+const unsigned SentenceReader::CHUNK_SIZE;
+
+SentenceReader::SentenceReader(const God& god, std::istream& input, unsigned numThreads,
+                               unsigned maxiBatchSize)
+  : god_(god),
+    input_(input),
+    maxiBatchSize_(std::max(maxiBatchSize, 1u)),
+    maxChunks_(4 * numThreads)
+{
+  if (numThreads > 0) {
+    pool_.reset(new ThreadPool(numThreads));
+  }
+}
+
+bool SentenceReader::Read(Chunk& chunk, unsigned maxLines) {
+  chunk.firstLineNum = numLines_;
+  chunk.lines.clear();
+
+  std::string line;
+  while (chunk.lines.size() < maxLines
+         && (chunk.lines.empty() || Buffered())
+         && std::getline(input_, line)) {
+    chunk.lines.push_back(line);
+  }
+  numLines_ += chunk.lines.size();
+  return !chunk.lines.empty();
+}
+
+bool SentenceReader::Buffered() const {
+  return input_.rdbuf()->in_avail() > 0;
+}
+
+std::vector<SentencePtr> SentenceReader::Preprocess(const God& god, const Chunk& chunk) {
+  std::vector<SentencePtr> sentences;
+  for (unsigned i = 0; i < chunk.lines.size(); ++i) {
+    sentences.emplace_back(new Sentence(god, chunk.firstLineNum + i, chunk.lines[i]));
+  }
+  return sentences;
+}
+
+bool SentenceReader::Next(std::vector<SentencePtr>& sentences) {
+  if (!pool_) {
+    Chunk chunk;
+    if (!Read(chunk, 1)) {
+      return false;
+    }
+    sentences = Preprocess(god_, chunk);
+    return true;
+  }
+
+  // read ahead while the workers are busy with the next chunk, but only
+  // block on the input when there is nothing else to hand out
+  while (!endOfInput_ && preprocessed_.size() < maxChunks_
+         && (preprocessed_.empty()
+             || (preprocessed_.front().wait_for(std::chrono::seconds(0)) != std::future_status::ready
+                 && Buffered()))) {
+    // end the chunk where the current maxi-batch is full
+    unsigned maxLines = std::min(CHUNK_SIZE, maxiBatchSize_ - numLines_ % maxiBatchSize_);
+    Chunk chunk;
+    if (!Read(chunk, maxLines)) {
+      endOfInput_ = true;
+      break;
+    }
+    const God& god = god_;
+    preprocessed_.push_back(pool_->enqueue([&god](const Chunk& chunk) {
+      return Preprocess(god, chunk);
+    }, std::move(chunk)));
+  }
+
+  if (preprocessed_.empty()) {
+    return false;
+  }
+  sentences = preprocessed_.front().get();
+  preprocessed_.pop_front();
+  return true;
+}
+
+}
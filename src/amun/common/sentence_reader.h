@@ -0,0 +1,66 @@
+#pragma once
+
+#include <deque>
+#include <future>
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common/sentence.h"
+#include "common/threadpool.h"
+
+namespace amunmt {
+
+class God;
+
+// Reads the input lines and builds their Sentences (splitting, BPE and
+// vocabulary lookup) as tasks on a pool of threads (--input-threads), so
+// that the translation threads do not wait for the main thread to
+// preprocess. Chunks of lines are handed out in input order and only a
+// bounded number of them is read ahead. A chunk ends early when it fills
+// the current maxi-batch or no more input is buffered, so streamed input
+// is not held back. Without threads Next reads and preprocesses one line.
+class SentenceReader {
+  public:
+    SentenceReader(const God& god, std::istream& input, unsigned numThreads,
+                   unsigned maxiBatchSize);
+
+    SentenceReader(const SentenceReader&) = delete;
+
+    // the sentences of the next chunk of lines, false at the end of input
+    bool Next(std::vector<SentencePtr>& sentences);
+
+  private:
+    struct Chunk {
+      unsigned firstLineNum;
+      std::vector<std::string> lines;
+    };
+
+    // most lines per chunk
+    static const unsigned CHUNK_SIZE = 32;
+
+    // the next line of input and up to maxLines - 1 more that are already
+    // buffered, false at its end
+    bool Read(Chunk& chunk, unsigned maxLines);
+
+    // whether input can be read without blocking
+    bool Buffered() const;
+
+    static std::vector<SentencePtr> Preprocess(const God& god, const Chunk& chunk);
+
+    const God& god_;
+    std::istream& input_;
+    const unsigned maxiBatchSize_;
+    unsigned numLines_ = 0;
+    bool endOfInput_ = false;
+
+    // chunks that are read and not yet returned by Next
+    const unsigned maxChunks_;
+    std::deque<std::future<std::vector<SentencePtr>>> preprocessed_;
+
+    // last, so that its threads are joined first
+    std::unique_ptr<ThreadPool> pool_;
+};
+
+}
@@ -22,14 +22,17 @@ freely, subject to the following restrictions:
    distribution.
 
 
-This source code has been modified to have optional bounded size.
+This source code has been modified to have optional bounded size, and to
+schedule tasks on per-worker deques with work stealing and subtasks.
 */
 
 #pragma once
 
+#include <atomic>
+#include <deque>
+#include <exception>
 #include <iostream>
 #include <vector>
-#include <queue>
 #include <memory>
 #include <thread>
 #include <mutex>
@@ -37,9 +40,19 @@ This source code has been modified to have optional bounded size.
 #include <future>
 #include <functional>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
 
 namespace amunmt {
 
+// Tasks given to enqueue are spread over the deques of the workers, and idle
+// workers steal from the others. A task may split its work into subtasks with
+// a TaskGroup. These are pushed to the deque of the worker running the task,
+// where idle workers steal them, and the task runs those nobody took while it
+// waits for the group. A thread waiting for subtasks only ever runs other
+// subtasks, never a task, so each task has its thread to itself from start to
+// end, including what the thread keeps in thread_local storage such as its
+// Search.
 class ThreadPool {
  public:
     explicit ThreadPool(size_t threads, size_t bound /* bound on size, or 0 for unbounded */ = 0);
@@ -50,46 +63,235 @@ class ThreadPool {
     ~ThreadPool();
 
     size_t getNumTasks() const {
-      return tasks.size();
+      return queued;
     }
 
+    // f(i) for i in [0, n), on the calling thread and any idle workers
+    template<class F>
+    void parallel_for(size_t n, F&& f);
+
+    class TaskGroup;
+
  private:
+    // a move-only callable, so that a packaged_task needs no shared_ptr
+    class Task {
+     public:
+        Task() {}
+
+        template<class F, class = typename std::enable_if<
+            !std::is_same<typename std::decay<F>::type, Task>::value>::type>
+        Task(F&& f)
+          : impl(new Impl<typename std::decay<F>::type>(std::forward<F>(f))) {}
+
+        void operator()() {
+          (*impl)();
+        }
+
+     private:
+        struct Base {
+          virtual ~Base() {}
+          virtual void operator()() = 0;
+        };
+
+        template<class F>
+        struct Impl : Base {
+          Impl(F&& f) : f(std::move(f)) {}
+          Impl(const F& f) : f(f) {}
+          void operator()() { f(); }
+          F f;
+        };
+
+        std::unique_ptr<Base> impl;
+    };
+
+    // tasks are taken from the front, subtasks from the back by their worker
+    // and from the front by thieves
+    struct Worker {
+      std::mutex mutex;
+      std::deque<Task> tasks;
+      std::deque<Task> subtasks;
+    };
+
+    void run(size_t index);
+
+    void push(size_t index, Task&& task, bool subtask);
+    bool popTask(size_t index, Task& task);
+    bool popSubtask(Task& task);
+
+    // the worker of this pool running on the calling thread, or the number
+    // of workers
+    size_t currentWorker() const;
+
+    // the pool and index of the worker running on this thread
+    static std::pair<const ThreadPool*, size_t>& current() {
+      static thread_local std::pair<const ThreadPool*, size_t> worker(nullptr, 0);
+      return worker;
+    }
+
     // need to keep track of threads so we can join them
     std::vector<std::thread> workers;
-    // the task queue
-    std::queue< std::function<void()> > tasks;
+    std::vector<std::unique_ptr<Worker>> queues;
+    std::atomic<size_t> next;
+
+    // tasks and subtasks in the deques, and tasks alone
+    std::atomic<size_t> pending;
+    std::atomic<size_t> queued;
 
     // synchronization
     std::mutex queue_mutex;
     std::condition_variable condition;
+    std::atomic<size_t> sleeping;
     std::size_t bound;
     std::condition_variable bounded_condition;
     bool stop;
 };
 
+// Subtasks of the task running on the calling thread. Waits for them in the
+// destructor if wait was not called, and wait rethrows the first exception
+// one of them threw.
+class ThreadPool::TaskGroup {
+ public:
+    explicit TaskGroup(ThreadPool& pool)
+      : pool(pool), worker(pool.currentWorker()), remaining(0) {}
+
+    TaskGroup(const TaskGroup&) = delete;
+
+    ~TaskGroup() {
+      join();
+    }
+
+    template<class F>
+    void spawn(F&& f);
+
+    void wait() {
+      join();
+      if (error) {
+        std::exception_ptr e = error;
+        error = nullptr;
+        std::rethrow_exception(e);
+      }
+    }
+
+ private:
+    void join() {
+      while (remaining > 0) {
+        help();
+      }
+      // the last subtask notifies under the mutex, so take it once more
+      // before the group can go away
+      std::lock_guard<std::mutex> lock(mutex);
+    }
+
+    // runs a subtask, or sleeps until the group is done if none is left to
+    // take, since the rest of this group's are then running elsewhere
+    void help() {
+      Task task;
+      if (pool.popSubtask(task)) {
+        task();
+      } else {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return remaining == 0; });
+      }
+    }
+
+    ThreadPool& pool;
+    size_t worker;
+    std::atomic<size_t> remaining;
+    std::mutex mutex;
+    std::condition_variable done;
+    std::exception_ptr error;
+};
+
 // the constructor just launches some amount of workers
 inline ThreadPool::ThreadPool(size_t threads, size_t in_bound)
-  : stop(false), bound(in_bound) {
+  : next(0), pending(0), queued(0), sleeping(0), bound(in_bound), stop(false) {
     for (size_t i = 0;i<threads;++i)
-      workers.emplace_back(
-          [this] {
-              for(;;) {
-                  std::function<void()> task;
-                  {
-                    std::unique_lock<std::mutex> lock(this->queue_mutex);
-                    this->condition.wait(lock,
-                        [this]{ return this->stop || !this->tasks.empty(); });
-                    if (this->stop && this->tasks.empty())
-                        return;
-                    task = std::move(this->tasks.front());
-                    this->tasks.pop();
-                  }
-                  this->bounded_condition.notify_one();
-
-                  task();
-              }
-          }
-      );
+      queues.emplace_back(new Worker());
+    for (size_t i = 0;i<threads;++i)
+      workers.emplace_back([this, i] { run(i); });
+}
+
+inline size_t ThreadPool::currentWorker() const {
+  return current().first == this ? current().second : queues.size();
+}
+
+inline void ThreadPool::run(size_t index) {
+  current() = std::make_pair(this, index);
+  for(;;) {
+    Task task;
+    if (popSubtask(task) || popTask(index, task)) {
+      task();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(this->queue_mutex);
+    ++sleeping;
+    this->condition.wait(lock,
+        [this]{ return this->stop || this->pending > 0; });
+    --sleeping;
+    if (this->stop && this->pending == 0)
+        return;
+  }
+}
+
+inline void ThreadPool::push(size_t index, Task&& task, bool subtask) {
+  {
+    Worker& worker = *queues[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    (subtask ? worker.subtasks : worker.tasks).push_back(std::move(task));
+    ++pending;
+  }
+  if (sleeping > 0) {
+    { std::lock_guard<std::mutex> lock(queue_mutex); }
+    condition.notify_one();
+  }
+}
+
+inline bool ThreadPool::popTask(size_t index, Task& task) {
+  for (size_t i = 0; i < queues.size(); ++i) {
+    Worker& worker = *queues[(index + i) % queues.size()];
+    {
+      std::lock_guard<std::mutex> lock(worker.mutex);
+      if (worker.tasks.empty()) {
+        continue;
+      }
+      task = std::move(worker.tasks.front());
+      worker.tasks.pop_front();
+      --pending;
+      --queued;
+    }
+    if (bound) {
+      { std::lock_guard<std::mutex> lock(queue_mutex); }
+      bounded_condition.notify_one();
+    }
+    return true;
+  }
+  return false;
+}
+
+inline bool ThreadPool::popSubtask(Task& task) {
+  size_t index = currentWorker();
+  if (index < queues.size()) {
+    Worker& worker = *queues[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (!worker.subtasks.empty()) {
+      task = std::move(worker.subtasks.back());
+      worker.subtasks.pop_back();
+      --pending;
+      return true;
+    }
+  }
+  for (auto& other : queues) {
+    Worker& worker = *other;
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (!worker.subtasks.empty()) {
+      task = std::move(worker.subtasks.front());
+      worker.subtasks.pop_front();
+      --pending;
+      return true;
+    }
+  }
+  return false;
 }
 
 // add new work item to the pool
@@ -99,25 +301,70 @@ auto ThreadPool::enqueue(F&& f, Args&&... args)
 {
   using return_type = typename std::result_of<F(Args...)>::type;
 
-  auto task = std::make_shared< std::packaged_task<return_type()> >(
+  std::packaged_task<return_type()> task(
           std::bind(std::forward<F>(f), std::forward<Args>(args)...)
       );
 
-  std::future<return_type> res = task->get_future();
+  std::future<return_type> res = task.get_future();
   {
       std::unique_lock<std::mutex> lock(queue_mutex);
-      this->bounded_condition.wait(lock, [this] { return this->tasks.size() < this->bound || this->bound == 0 || this->stop; });
+      this->bounded_condition.wait(lock, [this] { return this->queued < this->bound || this->bound == 0 || this->stop; });
       // don't allow enqueueing after stopping the pool
       if (stop) {
         throw std::runtime_error("enqueue on stopped ThreadPool");
       }
+      ++queued;
+  }
 
-      tasks.emplace([task](){ (*task)(); });
+  if (queues.empty()) {
+    --queued;
+    task();
+    return res;
   }
-  condition.notify_one();
+  push(next++ % queues.size(), Task(std::move(task)), false);
   return res;
 }
 
+template<class F>
+void ThreadPool::TaskGroup::spawn(F&& f) {
+  typename std::decay<F>::type fn(std::forward<F>(f));
+  ++remaining;
+  Task task([this, fn]() mutable {
+    try {
+      fn();
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!error) {
+        error = std::current_exception();
+      }
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--remaining == 0) {
+      done.notify_all();
+    }
+  });
+
+  if (pool.queues.empty()) {
+    task();
+  } else if (worker < pool.queues.size()) {
+    pool.push(worker, std::move(task), true);
+  } else {
+    pool.push(pool.next++ % pool.queues.size(), std::move(task), true);
+  }
+}
+
+template<class F>
+void ThreadPool::parallel_for(size_t n, F&& f) {
+  TaskGroup group(*this);
+  for (size_t i = 1; i < n; ++i) {
+    group.spawn([&f, i] { f(i); });
+  }
+  if (n > 0) {
+    f(0);
+  }
+  group.wait();
+}
+
 // the destructor joins all threads
 inline ThreadPool::~ThreadPool() {
   {
@@ -132,4 +379,3 @@ inline ThreadPool::~ThreadPool() {
 }
 
 }
-
@@ -0,0 +1,63 @@
+#include <algorithm>
+#include <cassert>
+
+#include "trellis.h"
+
+using namespace std;
+
+namespace amunmt {
+
+unsigned Trellis::Add(Word word, unsigned prev, float cost,
+                      const std::vector<float>& costBreakdown,
+                      const SoftAlignmentPtr& alignment)
+{
+  assert(prev == NONE || prev < size());
+  unsigned i = size();
+  words_.push_back(word);
+  prevs_.push_back(prev);
+  costs_.push_back(cost);
+
+  if (!costBreakdown.empty()) {
+    assert(breakdownSize_ == 0 || breakdownSize_ == costBreakdown.size());
+    breakdownSize_ = costBreakdown.size();
+    costBreakdowns_.resize(i * breakdownSize_, 0.0f);
+    costBreakdowns_.insert(costBreakdowns_.end(), costBreakdown.begin(), costBreakdown.end());
+  }
+
+  if (alignment) {
+    alignments_.resize(i);
+    alignments_.push_back(alignment);
+  }
+  return i;
+}
+
+std::vector<float> Trellis::GetCostBreakdown(unsigned i) const
+{
+  if ((i + 1) * breakdownSize_ > costBreakdowns_.size()) {
+    return std::vector<float>();
+  }
+  auto begin = costBreakdowns_.begin() + i * breakdownSize_;
+  return std::vector<float>(begin, begin + breakdownSize_);
+}
+
+Words Trellis::GetWords(unsigned i) const
+{
+  Words words;
+  for (; prevs_[i] != NONE; i = prevs_[i]) {
+    words.push_back(words_[i]);
+  }
+  std::reverse(words.begin(), words.end());
+  return words;
+}
+
+std::vector<SoftAlignmentPtr> Trellis::GetAlignments(unsigned i) const
+{
+  std::vector<SoftAlignmentPtr> alignments;
+  for (; prevs_[i] != NONE; i = prevs_[i]) {
+    alignments.push_back(i < alignments_.size() ? alignments_[i] : nullptr);
+  }
+  std::reverse(alignments.begin(), alignments.end());
+  return alignments;
+}
+
+}
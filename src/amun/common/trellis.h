@@ -0,0 +1,64 @@
+#pragma once
+
+#include <limits>
+#include <vector>
+
+#include "common/types.h"
+#include "common/soft_alignment.h"
+
+namespace amunmt {
+
+// All hypotheses of one sentence as flat arrays, one entry per hypothesis in
+// the order they were added. Entries refer to their predecessor by index, a
+// translation is read back by following these indices to the first entry.
+// Cost breakdowns (--n-best) and alignments are only stored when given.
+class Trellis {
+  public:
+    static const unsigned NONE = std::numeric_limits<unsigned>::max();
+
+    // returns the index of the new entry
+    unsigned Add(Word word, unsigned prev, float cost,
+                 const std::vector<float>& costBreakdown,
+                 const SoftAlignmentPtr& alignment);
+
+    unsigned size() const {
+      return words_.size();
+    }
+
+    bool empty() const {
+      return words_.empty();
+    }
+
+    Word GetWord(unsigned i) const {
+      return words_[i];
+    }
+
+    unsigned GetPrev(unsigned i) const {
+      return prevs_[i];
+    }
+
+    float GetCost(unsigned i) const {
+      return costs_[i];
+    }
+
+    // empty if no breakdown was stored
+    std::vector<float> GetCostBreakdown(unsigned i) const;
+
+    // words of the entries leading to i, without the first entry
+    Words GetWords(unsigned i) const;
+
+    // alignments in the same order as GetWords, null where none was stored
+    std::vector<SoftAlignmentPtr> GetAlignments(unsigned i) const;
+
+  private:
+    std::vector<Word> words_;
+    std::vector<unsigned> prevs_;
+    std::vector<float> costs_;
+
+    // side arrays, sized lazily by the first entry which has one
+    unsigned breakdownSize_ = 0;
+    std::vector<float> costBreakdowns_;
+    std::vector<SoftAlignmentPtr> alignments_;
+};
+
+}
@@ -1,5 +1,9 @@
 #include "common/vocab.h"
 
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
 #include <sstream>
 #include <yaml-cpp/yaml.h>
 
@@ -11,27 +15,178 @@ using namespace std;
 
 namespace amunmt {
 
+const char Vocab::MAGIC[8] = {'A', 'M', 'U', 'N', 'V', 'O', 'C', '\0'};
+const uint32_t Vocab::VERSION;
+
 Vocab::Vocab(const std::string& path) {
+  if (IsBinary(path)) {
+    Map(path);
+  } else {
+    Parse(path);
+  }
+}
+
+void Vocab::Parse(const std::string& path) {
+    std::map<std::string, Word> str2id;
+    std::vector<std::string> id2str;
     YAML::Node vocab = YAML::Load(InputFileStream(path));
     for(auto&& pair : vocab) {
       auto str = pair.first.as<std::string>();
       auto id = pair.second.as<Word>();
-      str2id_[str] = id;
-      if(id >= id2str_.size())
-        id2str_.resize(id + 1);
-      id2str_[id] = str;
+      str2id[str] = id;
+      if(id >= id2str.size())
+        id2str.resize(id + 1);
+      id2str[id] = str;
+    }
+    amunmt_UTIL_THROW_IF2(id2str.empty(), "Empty vocabulary " << path);
+    id2str.resize(std::max<size_t>(id2str.size(), UNK_ID + 1));
+    id2str[EOS_ID] = EOS_STR;
+    id2str[UNK_ID] = UNK_STR;
+
+    for (const std::string& str : id2str) {
+      parsedIdOffsets_.push_back(parsedBlob_.size());
+      parsedBlob_ += str;
+    }
+    parsedIdOffsets_.push_back(parsedBlob_.size());
+
+    for (const auto& pair : str2id) {
+      Key key;
+      key.length = pair.first.size();
+      key.id = pair.second;
+      if (id2str[key.id] == pair.first) {
+        key.offset = parsedIdOffsets_[key.id];
+      } else {
+        // e.g. the word of EOS_ID in the file
+        key.offset = parsedBlob_.size();
+        parsedBlob_ += pair.first;
+      }
+      parsedKeys_.push_back(key);
     }
-    amunmt_UTIL_THROW_IF2(id2str_.empty(), "Empty vocabulary " << path);
-    id2str_[EOS_ID] = EOS_STR;
-    id2str_[UNK_ID] = UNK_STR;
+
+    // power of two with at least half of the buckets empty
+    unsigned numBuckets = 2;
+    while (numBuckets < 2 * parsedKeys_.size()) {
+      numBuckets *= 2;
+    }
+    parsedBuckets_.resize(numBuckets, 0);
+    for (unsigned i = 0; i < parsedKeys_.size(); ++i) {
+      const Key& key = parsedKeys_[i];
+      unsigned bucket = Hash(&parsedBlob_[key.offset], key.length) & (numBuckets - 1);
+      while (parsedBuckets_[bucket]) {
+        bucket = (bucket + 1) & (numBuckets - 1);
+      }
+      parsedBuckets_[bucket] = i + 1;
+    }
+
+    idOffsets_ = parsedIdOffsets_.data();
+    keys_ = parsedKeys_.data();
+    buckets_ = parsedBuckets_.data();
+    blob_ = parsedBlob_.data();
+    numIds_ = id2str.size();
+    numKeys_ = parsedKeys_.size();
+    numBuckets_ = numBuckets;
+    blobSize_ = parsedBlob_.size();
+}
+
+void Vocab::Map(const std::string& path) {
+  binary_.reset(new MappedFile(path));
+
+  BinaryHeader header;
+  amunmt_UTIL_THROW_IF2(binary_->size() < sizeof(header), "Binary vocabulary " << path << " is truncated");
+  std::memcpy(&header, binary_->data(), sizeof(header));
+  amunmt_UTIL_THROW_IF2(header.version != VERSION,
+                        "Binary vocabulary " << path << " has version " << header.version
+                        << ", expected " << VERSION);
+
+  size_t size = sizeof(header)
+              + (size_t(header.numIds) + 1) * sizeof(uint32_t)
+              + size_t(header.numKeys) * sizeof(Key)
+              + size_t(header.numBuckets) * sizeof(uint32_t)
+              + header.blobSize;
+  amunmt_UTIL_THROW_IF2(binary_->size() != size,
+                        "Binary vocabulary " << path << " has " << binary_->size()
+                        << " bytes, expected " << size);
+
+  numIds_ = header.numIds;
+  numKeys_ = header.numKeys;
+  numBuckets_ = header.numBuckets;
+  blobSize_ = header.blobSize;
+  idOffsets_ = reinterpret_cast<const uint32_t*>(binary_->data() + sizeof(header));
+  keys_ = reinterpret_cast<const Key*>(idOffsets_ + numIds_ + 1);
+  buckets_ = reinterpret_cast<const uint32_t*>(keys_ + numKeys_);
+  blob_ = reinterpret_cast<const char*>(buckets_ + numBuckets_);
+
+  // every offset, id and bucket is checked once here, lookups trust them
+  amunmt_UTIL_THROW_IF2(numIds_ <= UNK_ID
+                        || numBuckets_ <= numKeys_
+                        || (numBuckets_ & (numBuckets_ - 1))
+                        || idOffsets_[0] != 0
+                        || idOffsets_[numIds_] > blobSize_,
+                        "Binary vocabulary " << path << " is corrupt");
+  for (unsigned i = 0; i < numIds_; ++i) {
+    amunmt_UTIL_THROW_IF2(idOffsets_[i] > idOffsets_[i + 1],
+                          "Binary vocabulary " << path << " has a corrupt offset of id " << i);
+  }
+  for (unsigned i = 0; i < numKeys_; ++i) {
+    const Key& key = keys_[i];
+    amunmt_UTIL_THROW_IF2(key.offset > blobSize_
+                          || key.length > blobSize_ - key.offset
+                          || key.id >= numIds_,
+                          "Binary vocabulary " << path << " has a corrupt word " << i);
+  }
+  // lookups probe until an empty bucket
+  bool empty = false;
+  for (unsigned i = 0; i < numBuckets_; ++i) {
+    amunmt_UTIL_THROW_IF2(buckets_[i] > numKeys_,
+                          "Binary vocabulary " << path << " has a corrupt bucket " << i);
+    empty |= buckets_[i] == 0;
+  }
+  amunmt_UTIL_THROW_IF2(!empty, "Binary vocabulary " << path << " has no empty bucket");
+}
+
+bool Vocab::IsBinary(const std::string& path) {
+  char magic[sizeof(MAGIC)];
+  std::ifstream file(path, std::ios::binary);
+  return file.read(magic, sizeof(magic)) && std::equal(magic, magic + sizeof(magic), MAGIC);
+}
+
+void Vocab::Save(const std::string& path) const {
+  BinaryHeader header;
+  std::copy(MAGIC, MAGIC + sizeof(MAGIC), header.magic);
+  header.version = VERSION;
+  header.numIds = numIds_;
+  header.numKeys = numKeys_;
+  header.numBuckets = numBuckets_;
+  header.blobSize = blobSize_;
+
+  std::ofstream file(path, std::ios::binary);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(idOffsets_), (numIds_ + 1) * sizeof(uint32_t));
+  file.write(reinterpret_cast<const char*>(keys_), numKeys_ * sizeof(Key));
+  file.write(reinterpret_cast<const char*>(buckets_), numBuckets_ * sizeof(uint32_t));
+  file.write(blob_, blobSize_);
+  amunmt_UTIL_THROW_IF2(!file, "Cannot write " << path);
+}
+
+// FNV-1a, which does not depend on the standard library like std::hash
+uint32_t Vocab::Hash(const char* str, size_t length) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; ++i) {
+    hash = (hash ^ (unsigned char)str[i]) * 16777619u;
+  }
+  return hash;
 }
 
 unsigned Vocab::operator[](const std::string& word) const {
-    auto it = str2id_.find(word);
-    if(it != str2id_.end())
-        return it->second;
-    else
-        return UNK_ID;
+  unsigned bucket = Hash(word.data(), word.size()) & (numBuckets_ - 1);
+  while (buckets_[bucket]) {
+    const Key& key = keys_[buckets_[bucket] - 1];
+    if (key.length == word.size() && std::memcmp(blob_ + key.offset, word.data(), key.length) == 0) {
+      return key.id;
+    }
+    bucket = (bucket + 1) & (numBuckets_ - 1);
+  }
+  return UNK_ID;
 }
 
 Words Vocab::operator()(const std::vector<std::string>& lineTokens, bool addEOS) const {
@@ -60,13 +215,13 @@ std::vector<std::string> Vocab::operator()(const Words& sentence, bool ignoreEOS
 }
 
 
-const std::string& Vocab::operator[](unsigned id) const {
-  amunmt_UTIL_THROW_IF2(id >= id2str_.size(), "Unknown word id: " << id);
-  return id2str_[id];
+std::string Vocab::operator[](unsigned id) const {
+  amunmt_UTIL_THROW_IF2(id >= numIds_, "Unknown word id: " << id);
+  return std::string(blob_ + idOffsets_[id], idOffsets_[id + 1] - idOffsets_[id]);
 }
 
 unsigned Vocab::size() const {
-  return id2str_.size();
+  return numIds_;
 }
 
 }
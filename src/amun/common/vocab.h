@@ -1,17 +1,27 @@
 #pragma once
 
-#include <map>
+#include <cstdint>
 #include <string>
 #include <vector>
 
 #include "common/types.h"
+#include "common/mapped_file.h"
 
 namespace amunmt {
 
 class Vocab {
   public:
+    // a YAML or JSON vocabulary, or one written by Save, which is mapped into
+    // memory instead of parsed
     Vocab(const std::string& path);
 
+    Vocab(const Vocab&) = delete;
+
+    // whether path starts like a vocabulary written by Save
+    static bool IsBinary(const std::string& path);
+
+    void Save(const std::string& path) const;
+
     unsigned operator[](const std::string& word) const;
 
     Words operator()(const std::vector<std::string>& lineTokens, bool addEOS = true) const;
@@ -20,17 +30,55 @@ class Vocab {
 
     std::vector<std::string> operator()(const Words& sentence, bool ignoreEOS = true) const;
 
-    const std::string& operator[](unsigned id) const;
+    std::string operator[](unsigned id) const;
 
     unsigned size() const;
 
   private:
-    typedef std::map<std::string, unsigned> Str2Id;
-    Str2Id str2id_;
+    void Parse(const std::string& path);
+
+    void Map(const std::string& path);
+
+    static uint32_t Hash(const char* str, size_t length);
+
+    struct BinaryHeader {
+      char magic[8];
+      uint32_t version;
+      uint32_t numIds;
+      uint32_t numKeys;
+      uint32_t numBuckets;
+      uint32_t blobSize;
+    };
+
+    // a word of the vocabulary file, blob_[offset] .. blob_[offset + length - 1]
+    struct Key {
+      uint32_t offset;
+      uint32_t length;
+      uint32_t id;
+    };
+
+    static const char MAGIC[8];
+    static const uint32_t VERSION = 1;
 
-    typedef std::vector<std::string> Id2Str;
-    Id2Str id2str_;
+    // The strings of all ids and words in one blob, that of id i is
+    // blob_[idOffsets_[i]] .. blob_[idOffsets_[i + 1] - 1]. buckets_ is an
+    // open addressing table of the words, with 1 + the index of a key or 0
+    // for empty buckets. All point either into the vectors below or into
+    // binary_.
+    const uint32_t* idOffsets_ = nullptr;
+    const Key* keys_ = nullptr;
+    const uint32_t* buckets_ = nullptr;
+    const char* blob_ = nullptr;
+    unsigned numIds_ = 0;
+    unsigned numKeys_ = 0;
+    unsigned numBuckets_ = 0;
+    unsigned blobSize_ = 0;
 
+    std::vector<uint32_t> parsedIdOffsets_;
+    std::vector<Key> parsedKeys_;
+    std::vector<uint32_t> parsedBuckets_;
+    std::string parsedBlob_;
+    MappedFilePtr binary_;
 };
 
 }
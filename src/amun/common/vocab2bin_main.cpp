@@ -0,0 +1,25 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "common/vocab.h"
+
+using namespace amunmt;
+
+// Converts a YAML or JSON vocabulary into the binary format, which amun maps
+// into memory and looks words up in by hashing instead of parsing it.
+int main(int argc, char* argv[]) {
+  if (argc != 3) {
+    std::cerr << "Usage: " << argv[0] << " vocab output" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  try {
+    Vocab vocab(argv[1]);
+    vocab.Save(argv[2]);
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
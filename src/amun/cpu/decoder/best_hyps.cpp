@@ -25,7 +25,8 @@ void BestHyps::CalcBeam(
     const std::vector<ScorerPtr>& scorers,
     const Words& filterIndices,
     std::vector<Beam>& beams,
-    std::vector<unsigned>& beamSizes)
+    std::vector<unsigned>& beamSizes,
+    bool isFirst)
 {
   BEGIN_TIMER_CPU("CalcBeam");
 
@@ -33,64 +34,95 @@ void BestHyps::CalcBeam(
 
   mblas::ArrayMatrix& Probs = static_cast<mblas::ArrayMatrix&>(scorers[0]->GetProbs());
 
-  mblas::ArrayMatrix Costs(Probs.rows(), 1);
-  for (size_t i = 0; i < prevHyps.size(); ++i) {
-    Costs.data()[i] = prevHyps[i]->GetCost();
-  }
+  // Rows of Probs are grouped by sentence. In the first step every sentence
+  // has a single row, afterwards sentence i owns beamSizes[i] rows.
+  const size_t cols = Probs.columns();
+  assert(Probs.rows() == (isFirst ? beamSizes.size()
+                                  : std::accumulate(beamSizes.begin(), beamSizes.end(), 0u)));
+
+  std::vector<size_t> bestKeys;
+  std::vector<float> bestCosts;
+  std::vector<unsigned> bestBatchIds;
+
+  if (god_.UseFusedSoftmax()) {
+    // Probs holds the logits of the only scorer, see God::Init()
+    std::vector<float> costs(prevHyps.size());
+    for (size_t i = 0; i < prevHyps.size(); ++i) {
+      costs[i] = prevHyps[i]->GetCost();
+    }
 
-  Probs *= weights_.at(scorers[0]->GetName());
-  AddBiasVector<byColumn>(Probs, Costs);
+    LogSoftmaxAndNBest(bestKeys, bestCosts, bestBatchIds, Probs, costs,
+                       weights_.at(scorers[0]->GetName()), forbidUNK_,
+                       beamSizes, isFirst);
+  } else {
+    mblas::ArrayMatrix Costs(Probs.rows(), 1);
+    for (size_t i = 0; i < prevHyps.size(); ++i) {
+      Costs.data()[i] = prevHyps[i]->GetCost();
+    }
 
-  for (size_t i = 1; i < scorers.size(); ++i) {
-    mblas::ArrayMatrix &currProb = static_cast<mblas::ArrayMatrix&>(scorers[i]->GetProbs());
+    Probs *= weights_.at(scorers[0]->GetName());
+    AddBiasVector<byColumn>(Probs, Costs);
 
-    Probs += weights_.at(scorers[i]->GetName()) * currProb;
-  }
+    for (size_t i = 1; i < scorers.size(); ++i) {
+      mblas::ArrayMatrix &currProb = static_cast<mblas::ArrayMatrix&>(scorers[i]->GetProbs());
 
-  size_t size = Probs.rows() * Probs.columns(); // Probs.size();
-  std::vector<size_t> keys(size);
-  for (size_t i = 0; i < keys.size(); ++i) {
-    keys[i] = i;
-  }
+      Probs += weights_.at(scorers[i]->GetName()) * currProb;
+    }
+
+    if (forbidUNK_) {
+      blaze::column(Probs, UNK_ID) = std::numeric_limits<float>::lowest();
+    }
 
-  size_t beamSize = beamSizes[0];
+    std::vector<size_t> keys;
 
-  std::vector<size_t> bestKeys(beamSize);
-  std::vector<float> bestCosts(beamSize);
+    size_t rowStart = 0;
+    for (size_t batchId = 0; batchId < beamSizes.size(); ++batchId) {
+      size_t rows = isFirst ? 1 : beamSizes[batchId];
+      size_t beamSize = std::min<size_t>(beamSizes[batchId], rows * cols);
 
-  if (forbidUNK_) {
-    blaze::column(Probs, UNK_ID) = std::numeric_limits<float>::lowest();
-  }
+      keys.resize(rows * cols);
+      for (size_t i = 0; i < keys.size(); ++i) {
+        keys[i] = rowStart * cols + i;
+      }
 
-  std::nth_element(keys.begin(), keys.begin() + beamSize, keys.end(),
-                   ProbCompare(Probs.data()));
+      std::nth_element(keys.begin(), keys.begin() + beamSize, keys.end(),
+                       ProbCompare(Probs.data()));
 
-  for (size_t i = 0; i < beamSize; ++i) {
-    bestKeys[i] = keys[i];
-    bestCosts[i] = Probs.data()[keys[i]];
+      for (size_t i = 0; i < beamSize; ++i) {
+        bestKeys.push_back(keys[i]);
+        bestCosts.push_back(Probs.data()[keys[i]]);
+        bestBatchIds.push_back(batchId);
+      }
+
+      rowStart += rows;
+    }
   }
 
+  const size_t beamSize = bestKeys.size();
+
   std::vector<std::vector<float>> breakDowns;
   if (god_.ReturnNBestList()) {
+    // with the fused softmax Probs holds logits, but there is only one scorer
+    // then and its breakdown is taken from bestCosts
     breakDowns.push_back(bestCosts);
     for (auto& scorer : scorers) {
       std::vector<float> modelCosts(beamSize);
       mblas::ArrayMatrix &currProb = static_cast<mblas::ArrayMatrix&>(scorer->GetProbs());
 
-      auto it = boost::make_permutation_iterator(currProb.begin(), keys.begin());
+      auto it = boost::make_permutation_iterator(currProb.begin(), bestKeys.begin());
       std::copy(it, it + beamSize, modelCosts.begin());
       breakDowns.push_back(modelCosts);
     }
   }
 
   for (size_t i = 0; i < beamSize; i++) {
-    size_t wordIndex = bestKeys[i] % Probs.columns();
+    size_t wordIndex = bestKeys[i] % cols;
 
     if (isInputFiltered_) {
       wordIndex = filterIndices[wordIndex];
     }
 
-    size_t hypIndex  = bestKeys[i] / Probs.columns();
+    size_t hypIndex  = bestKeys[i] / cols;
     float cost = bestCosts[i];
 
     HypothesisPtr hyp;
@@ -98,17 +130,19 @@ void BestHyps::CalcBeam(
       std::vector<SoftAlignmentPtr> alignments;
       for (auto& scorer : scorers) {
         if (CPU::CPUEncoderDecoderBase* encdec = dynamic_cast<CPU::CPUEncoderDecoderBase*>(scorer.get())) {
+          // drop the padding columns of sentences shorter than the batch
           auto& attention = encdec->GetAttention();
+          unsigned length = encdec->GetSentenceLengths()[bestBatchIds[i]];
           alignments.emplace_back(new SoftAlignment(attention.begin(hypIndex),
-                                                    attention.end(hypIndex)));
+                                                    attention.begin(hypIndex) + length));
         } else {
           amunmt_UTIL_THROW2("Return Alignment is allowed only with Nematus scorer.");
         }
       }
 
-      hyp.reset(new Hypothesis(prevHyps[hypIndex], wordIndex, hypIndex, cost, alignments));
+      hyp = std::make_shared<Hypothesis>(prevHyps[hypIndex], wordIndex, hypIndex, cost, alignments);
     } else {
-      hyp.reset(new Hypothesis(prevHyps[hypIndex], wordIndex, hypIndex, cost));
+      hyp = std::make_shared<Hypothesis>(prevHyps[hypIndex], wordIndex, hypIndex, cost);
     }
 
     if (god_.ReturnNBestList()) {
@@ -131,7 +165,7 @@ void BestHyps::CalcBeam(
       hyp->GetCostBreakdown()[0] -= sum;
       hyp->GetCostBreakdown()[0] /= weights_.at(scorers[0]->GetName());
     }
-    beams[0].push_back(hyp);
+    beams[bestBatchIds[i]].push_back(hyp);
   }
 
   PAUSE_TIMER_CPU("CalcBeam");
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <numeric>
 #include <boost/iterator/permutation_iterator.hpp>
 
 #include "common/scorer.h"
@@ -22,7 +23,8 @@ class BestHyps : public BaseBestHyps
         const std::vector<ScorerPtr>& scorers,
         const Words& filterIndices,
         std::vector<Beam>& beams,
-        std::vector<unsigned>& beamSizes);
+        std::vector<unsigned>& beamSizes,
+        bool isFirst);
 
 };
 
@@ -15,8 +15,10 @@ CPUEncoderDecoderBase::CPUEncoderDecoderBase(
 	const God &god,
     const std::string& name,
     const YAML::Node& config,
-    unsigned tab)
-  : Scorer(god, name, config, tab)
+    unsigned tab,
+    FilteredOutputCache* filterCache)
+  : Scorer(god, name, config, tab),
+    filterCache_(filterCache)
 {}
 
 State* CPUEncoderDecoderBase::NewState() const {
@@ -5,6 +5,7 @@
 #include "common/scorer.h"
 #include "cpu/mblas/tensor.h"
 #include "cpu/decoder/encoder_decoder_state.h"
+#include "cpu/decoder/filtered_output_cache.h"
 
 namespace amunmt {
 namespace CPU {
@@ -18,13 +19,18 @@ class CPUEncoderDecoderBase : public Scorer {
     	const God &god,
         const std::string& name,
         const YAML::Node& config,
-        unsigned tab);
+        unsigned tab,
+        FilteredOutputCache* filterCache = nullptr);
 
     virtual State* NewState() const;
 
     virtual void GetAttention(mblas::Tensor& Attention) = 0;
     virtual mblas::Tensor& GetAttention() = 0;
 
+    const std::vector<unsigned>& GetSentenceLengths() const {
+      return sentenceLengths_;
+    }
+
     virtual void *GetNBest()
     {
       assert(false);
@@ -39,6 +45,10 @@ class CPUEncoderDecoderBase : public Scorer {
 
   protected:
     mblas::Tensor SourceContext_;
+    std::vector<unsigned> sentenceLengths_;
+
+    // owned by the loader, null if disabled
+    FilteredOutputCache* filterCache_;
 };
 
 
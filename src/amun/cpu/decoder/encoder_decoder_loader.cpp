@@ -1,6 +1,8 @@
 #include "cpu/decoder/encoder_decoder_loader.h"
 
+#include <algorithm>
 #include <vector>
+#include <boost/timer/timer.hpp>
 #include <yaml-cpp/yaml.h>
 
 #include "common/god.h"
@@ -19,16 +21,64 @@ EncoderDecoderLoader::EncoderDecoderLoader(
   : Loader(name, config)
 {}
 
-void EncoderDecoderLoader::Load(const God&) {
+EncoderDecoderLoader::~EncoderDecoderLoader() {
+  if (filterCache_ && filterCache_->Hits() + filterCache_->Misses() > 0) {
+    LOG(info)->info("Filtered output layer cache of {}: {} hits, {} misses",
+                    name_, filterCache_->Hits(), filterCache_->Misses());
+  }
+}
+
+void EncoderDecoderLoader::Load(const God &god) {
   std::string path = Get<std::string>("path");
   std::string type = Get<std::string>("type");
 
   LOG(info)->info("Loading model {}", path);
   LOG(info)->info("Model type: {}", type);
+  LOG(info)->info("CPU elementwise kernels: {}", mblas::simd::InstructionSet());
+  mblas::WeightLayout layout = mblas::WeightLayout::Blaze;
+  if (god.Get<bool>("cpu-int8")) {
+    layout = mblas::WeightLayout::Int8;
+  } else if (god.Get<bool>("cpu-packed-weights")) {
+    layout = mblas::WeightLayout::Panels;
+  }
+
+  bool vocabMajorOutput = false;
+  if (god.Get<bool>("cpu-vocab-major-output")) {
+    if (god.Get<std::vector<std::string>>("softmax-filter").empty()) {
+      LOG(info)->warn("--cpu-vocab-major-output is only used with --softmax-filter, ignoring");
+    } else {
+      LOG(info)->info("Keeping a vocab-major copy of the output layer");
+      vocabMajorOutput = true;
+    }
+  }
+
+  // the scorers are loaded concurrently, so they share the CPU threads
+  unsigned numThreads = std::max<unsigned>(god.Get<unsigned>("cpu-threads") / god.Get("scorers").size(), 1);
+
+  boost::timer::cpu_timer timer;
+  NpzConverter model(path, numThreads);
+  std::string readTime = timer.format(2, "%ws");
+
+  boost::timer::cpu_timer weightsTimer;
   if (type == "nematus2") {
-    nematusModels_.emplace_back(new Nematus::Weights(path, 0));
+    if (layout == mblas::WeightLayout::Int8) {
+      LOG(info)->info("Quantizing weights to int8");
+    } else if (layout == mblas::WeightLayout::Panels) {
+      LOG(info)->info("Packing weights into GEMM panels");
+    }
+    nematusModels_.emplace_back(new Nematus::Weights(model, 0, layout, vocabMajorOutput));
   } else {
-    dl4mtModels_.emplace_back(new dl4mt::Weights(path, 0));
+    if (layout != mblas::WeightLayout::Blaze) {
+      LOG(info)->warn("--cpu-int8 and --cpu-packed-weights are only supported for nematus2 models, ignoring");
+    }
+    dl4mtModels_.emplace_back(new dl4mt::Weights(model, 0, vocabMajorOutput));
+  }
+  LOG(info)->info("Loaded model {} in {} (reading {}, building weights {})",
+                  path, timer.format(2, "%ws"), readTime, weightsTimer.format(2, "%ws"));
+
+  unsigned cacheSize = god.Get<unsigned>("cpu-softmax-filter-cache");
+  if (cacheSize > 0) {
+    filterCache_.reset(new FilteredOutputCache(size_t(cacheSize) << 20));
   }
 }
 
@@ -37,10 +87,10 @@ ScorerPtr EncoderDecoderLoader::NewScorer(const God &god, const DeviceInfo&) con
   std::string type = Get<std::string>("type");
   if (type == "nematus2") {
     return ScorerPtr(new Nematus::EncoderDecoder(god, name_, config_,
-                                              tab, *nematusModels_[0]));
+                                              tab, *nematusModels_[0], filterCache_.get()));
   }
   return ScorerPtr(new dl4mt::EncoderDecoder(god, name_, config_,
-                                             tab, *dl4mtModels_[0]));
+                                             tab, *dl4mtModels_[0], filterCache_.get()));
 }
 
 BaseBestHypsPtr EncoderDecoderLoader::GetBestHyps(const God &god, const DeviceInfo &deviceInfo) const {
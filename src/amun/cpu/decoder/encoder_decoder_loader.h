@@ -8,6 +8,7 @@
 #include "common/loader.h"
 #include "common/logging.h"
 #include "common/base_best_hyps.h"
+#include "cpu/decoder/filtered_output_cache.h"
 
 namespace amunmt {
 namespace CPU {
@@ -24,6 +25,7 @@ class EncoderDecoderLoader : public Loader {
   public:
     EncoderDecoderLoader(const std::string name,
                          const YAML::Node& config);
+    ~EncoderDecoderLoader();
 
     virtual void Load(const God& god);
 
@@ -33,6 +35,7 @@ class EncoderDecoderLoader : public Loader {
   private:
     std::vector<std::unique_ptr<dl4mt::Weights>> dl4mtModels_;
     std::vector<std::unique_ptr<Nematus::Weights>> nematusModels_;
+    std::unique_ptr<FilteredOutputCache> filterCache_;
 };
 
 } // namespace CPU
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include <boost/functional/hash.hpp>
+
+#include "common/lru_cache.h"
+#include "cpu/mblas/tensor.h"
+#include "cpu/mblas/packed.h"
+
+namespace amunmt {
+namespace CPU {
+
+// Output layer restricted to the shortlist of a batch (--softmax-filter)
+struct FilteredOutput {
+  mblas::Tensor W4;
+  mblas::Tensor B4;
+  mblas::PackedTensor W4p;
+
+  size_t Bytes() const {
+    return (W4.rows() * W4.spacing() + B4.rows() * B4.spacing()) * sizeof(float) + W4p.bytes();
+  }
+};
+
+struct FilteredOutputBytes {
+  size_t operator()(const FilteredOutput& output) const {
+    return output.Bytes();
+  }
+};
+
+// Filtered output layers of the most recent shortlists of a model, shared by
+// all threads (--cpu-softmax-filter-cache). Repeated sentences often produce
+// the same shortlist, and gathering the columns of W4 is the expensive part of
+// Softmax::Filter. An entry holds a hidden size x shortlist size copy of the
+// output layer, tens of MB for large shortlists, so the cache is bounded by
+// bytes, in a single shard so that one entry may use all of them.
+typedef LRUCache<std::vector<unsigned>, FilteredOutput,
+                 boost::hash<std::vector<unsigned>>, FilteredOutputBytes> FilteredOutputCache;
+
+typedef FilteredOutputCache::ValuePtr FilteredOutputPtr;
+
+}
+}
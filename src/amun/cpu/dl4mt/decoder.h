@@ -4,6 +4,8 @@
 #include "model.h"
 #include "gru.h"
 #include "common/god.h"
+#include "common/threadpool.h"
+#include "cpu/decoder/filtered_output_cache.h"
 
 namespace amunmt {
 namespace CPU {
@@ -19,12 +21,12 @@ class Decoder {
         {}
 
         void Lookup(mblas::Tensor& Rows, const std::vector<unsigned>& ids) {
-          using namespace mblas;
-          std::vector<unsigned> tids = ids;
-          for(auto&& id : tids)
-            if(id >= w_.E_.rows())
-              id = 1;
-          Rows = Assemble<byRow, Tensor>(w_.E_, tids);
+          // out of vocabulary ids are looked up as UNK_ID
+          Rows.resize(ids.size(), w_.E_.columns(), false);
+          for (unsigned i = 0; i < ids.size(); ++i) {
+            unsigned id = ids[i] < w_.E_.rows() ? ids[i] : UNK_ID;
+            blaze::row(Rows, i) = blaze::row(w_.E_, id);
+          }
         }
 
         size_t GetCols() {
@@ -48,15 +50,23 @@ class Decoder {
 
         void InitializeState(mblas::Tensor& State,
                              const mblas::Tensor& SourceContext,
-                             const size_t batchSize = 1) {
+                             const std::vector<unsigned>& sentenceLengths) {
           using namespace mblas;
 
-          // Calculate mean of source context, rowwise
-          // Repeat mean batchSize times by broadcasting
-          Temp1_ = Mean<byRow, Tensor>(SourceContext);
+          // Calculate mean of each sentence's source context, rowwise,
+          // skipping the padding
+          size_t batchSize = sentenceLengths.size();
+          size_t maxLength = SourceContext.rows() / batchSize;
+
           Temp2_.resize(batchSize, SourceContext.columns());
           Temp2_ = 0.0f;
-          AddBiasVector<byRow>(Temp2_, Temp1_);
+          for (size_t i = 0; i < batchSize; ++i) {
+            if (sentenceLengths[i]) {
+              Temp1_ = Mean<byRow, Tensor>(blaze::submatrix(SourceContext, i * maxLength, 0,
+                                                            sentenceLengths[i], SourceContext.columns()));
+              blaze::row(Temp2_, i) = blaze::row(Temp1_, 0);
+            }
+          }
 
           State = Temp2_ * w_.Wi_;
 
@@ -121,7 +131,9 @@ class Decoder {
 
         void GetAlignedSourceContext(mblas::Tensor& AlignedSourceContext,
                                      const mblas::Tensor& HiddenState,
-                                     const mblas::Tensor& SourceContext) {
+                                     const mblas::Tensor& SourceContext,
+                                     const std::vector<unsigned>& sentenceLengths,
+                                     const std::vector<unsigned>& beamSizes) {
           using namespace mblas;
 
           Temp2_ = HiddenState * w_.W_;
@@ -129,20 +141,40 @@ class Decoder {
             LayerNormalization(Temp2_, w_.Gamma_2_);
           }
 
-          Temp1_ = Broadcast<Tensor>(Tanh(), SCU_, Temp2_);
-
-          A_.resize(Temp1_.rows(), 1);
-          blaze::column(A_, 0) = Temp1_ * V_;
-          size_t words = SourceContext.rows();
-          // batch size, for batching, divide by numer of sentences
-          size_t batchSize = HiddenState.rows();
-          Reshape(A_, batchSize, words); // due to broadcasting above
-
-          float bias = w_.C_(0,0);
-          blaze::forEach(A_, [=](float x) { return x + bias; });
-
-          mblas::SafeSoftmax(A_);
-          AlignedSourceContext = A_ * SourceContext;
+          // hypotheses are grouped by sentence, beamSizes[i] rows for sentence i.
+          // Attention weights of padded source positions stay 0.
+          // The c_tt bias is a constant shift which the softmax is invariant to.
+          size_t batchSize = sentenceLengths.size();
+          size_t maxLength = SourceContext.rows() / batchSize;
+          size_t cols = SourceContext.columns();
+
+          A_.resize(HiddenState.rows(), maxLength, false);
+          A_ = 0.0f;
+          AlignedSourceContext.resize(HiddenState.rows(), cols, false);
+          AlignedSourceContext = 0.0f;
+
+          size_t hypStart = 0;
+          for (size_t i = 0; i < batchSize; ++i) {
+            size_t beamSize = beamSizes[i];
+            size_t words = sentenceLengths[i];
+            if (beamSize == 0 || words == 0) {
+              hypStart += beamSize;
+              continue;
+            }
+
+            auto A = blaze::submatrix(A_, hypStart, 0, beamSize, words);
+            AttentionScores(A,
+                            blaze::submatrix(SCU_, i * maxLength, 0, words, SCU_.columns()),
+                            blaze::submatrix(Temp2_, hypStart, 0, beamSize, Temp2_.columns()),
+                            V_);
+
+            mblas::SafeSoftmax(A);
+            blaze::submatrix(AlignedSourceContext, hypStart, 0, beamSize, cols) =
+              A * blaze::submatrix(SourceContext, i * maxLength, 0, words, cols);
+
+            hypStart += beamSize;
+          }
+          assert(hypStart == HiddenState.rows());
         }
 
         void GetAttention(mblas::Tensor& Attention) {
@@ -157,7 +189,6 @@ class Decoder {
         const Weights& w_;
 
         mblas::Tensor SCU_;
-        mblas::Tensor Temp1_;
         mblas::Tensor Temp2_;
         mblas::Tensor A_;
         mblas::ColumnVector V_;
@@ -167,15 +198,18 @@ class Decoder {
     template <class Weights>
     class Softmax {
       public:
-        Softmax(const Weights& model)
+        // pool, shards: see ProdW4
+        Softmax(const Weights& model, ThreadPool* pool, unsigned shards)
         : w_(model),
-        filtered_(false)
+          pool_(pool),
+          shards_(shards)
         {}
 
         void GetProbs(mblas::ArrayMatrix& Probs,
                   const mblas::Tensor& State,
                   const mblas::Tensor& Embedding,
-                  const mblas::Tensor& AlignedSourceContext) {
+                  const mblas::Tensor& AlignedSourceContext,
+                  bool useFusedSoftmax) {
           using namespace mblas;
 
 
@@ -197,31 +231,54 @@ class Decoder {
           }
           AddBiasVector<byRow>(T3_, w_.B3_);
 
-          auto t = blaze::forEach(T1_ + T2_ + T3_, Tanh());
+          T1_ += T2_;
+          AddTanh(T1_, T3_);
 
           if(!filtered_) {
-            Probs = t * w_.W4_;
+            ProdW4(Probs, w_.W4_);
             AddBiasVector<byRow>(Probs, w_.B4_);
           } else {
-            Probs = t * FilteredW4_;
-            AddBiasVector<byRow>(Probs, FilteredB4_);
+            ProdW4(Probs, filtered_->W4);
+            AddBiasVector<byRow>(Probs, filtered_->B4);
+          }
+          if (!useFusedSoftmax) {
+            LogSoftmax(Probs);
           }
-          LogSoftmax(Probs);
         }
 
-        void Filter(const std::vector<unsigned>& ids) {
-          filtered_ = true;
-          using namespace mblas;
-          FilteredW4_ = Assemble<byColumn, Tensor>(w_.W4_, ids);
-          FilteredB4_ = Assemble<byColumn, Tensor>(w_.B4_, ids);
+        void Filter(const std::vector<unsigned>& ids, FilteredOutputCache* cache) {
+          auto assemble = [&] {
+            using namespace mblas;
+            FilteredOutput output;
+            if (w_.W4T_.rows() > 0) {
+              AssembleTransposed(output.W4, w_.W4T_, ids);
+            } else {
+              output.W4 = Assemble<byColumn, Tensor>(w_.W4_, ids);
+            }
+            output.B4 = Assemble<byColumn, Tensor>(w_.B4_, ids);
+            return output;
+          };
+          if (cache) {
+            filtered_ = cache->Get(ids, assemble);
+          } else {
+            filtered_ = std::make_shared<const FilteredOutput>(assemble());
+          }
         }
 
       private:
+        // Probs = T1_ * W4, in shards_ subtasks on pool_ if there is one
+        template <class MT>
+        void ProdW4(mblas::ArrayMatrix& Probs, const MT& W4) {
+          mblas::ShardedProd(Probs, T1_, W4, pool_ ? shards_ : 1,
+                             [this](size_t n, auto&& shard) { pool_->parallel_for(n, shard); });
+        }
+
         const Weights& w_;
-        bool filtered_;
+        ThreadPool* pool_;
+        unsigned shards_;
 
-        mblas::Tensor FilteredW4_;
-        mblas::Tensor FilteredB4_;
+        // null without --softmax-filter
+        FilteredOutputPtr filtered_;
 
         mblas::Tensor T1_;
         mblas::Tensor T2_;
@@ -229,22 +286,27 @@ class Decoder {
     };
 
   public:
-    Decoder(const Weights& model)
+    // pool, vocabShards: see Softmax::ProdW4, --cpu-vocab-shards
+    Decoder(const Weights& model, ThreadPool* pool = nullptr, unsigned vocabShards = 1)
     : embeddings_(model.decEmbeddings_),
       rnn1_(model.decInit_, model.decGru1_),
       rnn2_(model.decGru2_),
 	  attention_(model.decAttention_),
-      softmax_(model.decSoftmax_)
+      softmax_(model.decSoftmax_, pool, vocabShards)
     {}
 
     void Decode(mblas::Tensor& NextState,
                   const mblas::Tensor& State,
                   const mblas::Tensor& Embeddings,
-                  const mblas::Tensor& SourceContext) {
+                  const mblas::Tensor& SourceContext,
+                  const std::vector<unsigned>& sentenceLengths,
+                  const std::vector<unsigned>& beamSizes,
+                  bool useFusedSoftmax) {
       GetHiddenState(HiddenState_, State, Embeddings);
-      GetAlignedSourceContext(AlignedSourceContext_, HiddenState_, SourceContext);
+      GetAlignedSourceContext(AlignedSourceContext_, HiddenState_, SourceContext,
+                              sentenceLengths, beamSizes);
       GetNextState(NextState, HiddenState_, AlignedSourceContext_);
-      GetProbs(NextState, Embeddings, AlignedSourceContext_);
+      GetProbs(NextState, Embeddings, AlignedSourceContext_, useFusedSoftmax);
     }
 
     mblas::ArrayMatrix& GetProbs() {
@@ -253,8 +315,8 @@ class Decoder {
 
     void EmptyState(mblas::Tensor& State,
                     const mblas::Tensor& SourceContext,
-                    size_t batchSize = 1) {
-    	rnn1_.InitializeState(State, SourceContext, batchSize);
+                    const std::vector<unsigned>& sentenceLengths) {
+    	rnn1_.InitializeState(State, SourceContext, sentenceLengths);
     	attention_.Init(SourceContext);
     }
 
@@ -269,8 +331,8 @@ class Decoder {
       embeddings_.Lookup(Embedding, w);
     }
 
-    void Filter(const std::vector<unsigned>& ids) {
-      softmax_.Filter(ids);
+    void Filter(const std::vector<unsigned>& ids, FilteredOutputCache* cache) {
+      softmax_.Filter(ids, cache);
     }
 
     void GetAttention(mblas::Tensor& attention) {
@@ -295,8 +357,11 @@ class Decoder {
 
     void GetAlignedSourceContext(mblas::Tensor& AlignedSourceContext,
                                  const mblas::Tensor& HiddenState,
-                                 const mblas::Tensor& SourceContext) {
-    	attention_.GetAlignedSourceContext(AlignedSourceContext, HiddenState, SourceContext);
+                                 const mblas::Tensor& SourceContext,
+                                 const std::vector<unsigned>& sentenceLengths,
+                                 const std::vector<unsigned>& beamSizes) {
+    	attention_.GetAlignedSourceContext(AlignedSourceContext, HiddenState, SourceContext,
+    	                                   sentenceLengths, beamSizes);
     }
 
     void GetNextState(mblas::Tensor& State,
@@ -308,8 +373,9 @@ class Decoder {
 
     void GetProbs(const mblas::Tensor& State,
                   const mblas::Tensor& Embedding,
-                  const mblas::Tensor& AlignedSourceContext) {
-      softmax_.GetProbs(Probs_, State, Embedding, AlignedSourceContext);
+                  const mblas::Tensor& AlignedSourceContext,
+                  bool useFusedSoftmax) {
+      softmax_.GetProbs(Probs_, State, Embedding, AlignedSourceContext, useFusedSoftmax);
     }
 
   private:
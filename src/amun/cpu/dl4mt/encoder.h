@@ -1,6 +1,8 @@
 #pragma once
 
 #include "../mblas/tensor.h"
+#include "common/sentences.h"
+#include "common/threadpool.h"
 #include "../dl4mt/model.h"
 #include "../dl4mt/gru.h"
 
@@ -19,12 +21,23 @@ class Encoder {
         : w_(model)
         {}
           
-        void Lookup(mblas::Tensor& Row, size_t i) {
-		  size_t len = w_.E_.columns();
-          if(i < w_.E_.rows())
-            Row = blaze::submatrix(w_.E_, i, 0, 1, len);
-          else
-            Row = blaze::submatrix(w_.E_, 1, 0, 1, len); // UNK
+        // time-major, row t * sources.size() + i holds the word at position t
+        // of sentence i, zero rows for sentences shorter than t
+        void Lookup(mblas::Tensor& Rows, const Sentences& sources, unsigned tab, size_t maxLength) {
+          Rows.resize(maxLength * sources.size(), w_.E_.columns());
+          for (size_t i = 0; i < sources.size(); ++i) {
+            const Words& words = sources.Get(i).GetWords(tab);
+            for (size_t t = 0; t < maxLength; ++t) {
+              size_t r = t * sources.size() + i;
+              if (t >= words.size()) {
+                blaze::row(Rows, r) = 0.0f;
+              } else if (words[t] < w_.E_.rows()) {
+                blaze::row(Rows, r) = blaze::row(w_.E_, words[t]);
+              } else {
+                blaze::row(Rows, r) = blaze::row(w_.E_, 1); // UNK
+              }
+            }
+          }
         }
       
         const Weights& w_;
@@ -43,28 +56,33 @@ class Encoder {
 		  State_ = 0.0f;
         }
         
-        void GetNextState(mblas::Tensor& NextState,
-                          const mblas::Tensor& State,
-                          const mblas::Tensor& Embd) {
-          gru_.GetNextState(NextState, State, Embd);
-        }
-        
-        template <class It>
-        void Encode(It it, It end,
-                        mblas::Tensor& Context, bool invert) {
-          InitializeState();
-          
-          size_t n = std::distance(it, end);
-          size_t i = 0;
-          while(it != end) {
-            GetNextState(State_, State_, *it++);
-            
-			size_t len = gru_.GetStateLength();
-            if(invert)
-              blaze::submatrix(Context, n - i - 1, len, 1, len) = State_;
-            else
-			  blaze::submatrix(Context, i, 0, 1, len) = State_;
-            ++i;
+        // embedded as returned by Embeddings::Lookup. The input projection of
+        // all words is one product, only the state product is per position.
+        void Encode(const mblas::Tensor& embedded, mblas::Tensor& Context,
+                    const std::vector<unsigned>& sentenceLengths, bool invert) {
+          size_t batchSize = sentenceLengths.size();
+          InitializeState(batchSize);
+
+          size_t n = embedded.rows() / batchSize;
+          size_t len = gru_.GetStateLength();
+          gru_.ProjectInput(Input_, embedded);
+          for (size_t i = 0; i < n; ++i) {
+            size_t pos = invert ? n - i - 1 : i;
+            gru_.GetNextStateFromInput(State_, State_,
+                                       blaze::submatrix(Input_, pos * batchSize, 0, batchSize, Input_.columns()));
+
+            for (size_t j = 0; j < batchSize; ++j) {
+              if (pos >= sentenceLengths[j]) {
+                // padding: keep the backward state at zero until the sentence starts
+                if (invert) {
+                  blaze::row(State_, j) = 0.0f;
+                }
+                continue;
+              }
+
+              size_t col = invert ? len : 0;
+              blaze::submatrix(Context, j * n + pos, col, 1, len) = blaze::submatrix(State_, j, 0, 1, len);
+            }
           }
         }
         
@@ -77,23 +95,32 @@ class Encoder {
         const GRU<Weights> gru_;
         
         mblas::Tensor State_;
+        mblas::Tensor Input_;
     };
     
   /////////////////////////////////////////////////////////////////
   public:
-    Encoder(const Weights& model)
+    // pool: run the backward RNN as a subtask on pool, --cpu-parallel-encoder
+    Encoder(const Weights& model, ThreadPool* pool = nullptr)
     : embeddings_(model.encEmbeddings_),
       forwardRnn_(model.encForwardGRU_),
-      backwardRnn_(model.encBackwardGRU_)
+      backwardRnn_(model.encBackwardGRU_),
+      pool_(pool)
     {}
     
-    void Encode(const std::vector<unsigned>& words,
-                    mblas::Tensor& context);
+    // context rows are sentence-major and padded to the longest sentence:
+    // sentence i occupies rows [i * maxLength, i * maxLength + sentenceLengths[i])
+    void Encode(const Sentences& sources, unsigned tab,
+                mblas::Tensor& context, std::vector<unsigned>& sentenceLengths);
     
   private:
     Embeddings<Weights::Embeddings> embeddings_;
     RNN<Weights::GRU> forwardRnn_;
     RNN<Weights::GRU> backwardRnn_;
+    ThreadPool* pool_;
+
+    // reused to avoid allocation
+    mblas::Tensor embeddedWords_;
 };
 
 }
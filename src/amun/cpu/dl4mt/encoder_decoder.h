@@ -28,7 +28,8 @@ class EncoderDecoder : public CPUEncoderDecoderBase {
     			   const std::string& name,
                    const YAML::Node& config,
                    unsigned tab,
-                   const Weights& model);
+                   const Weights& model,
+                   FilteredOutputCache* filterCache = nullptr);
 
     virtual void Decode(
         const State& in,
@@ -56,6 +57,10 @@ class EncoderDecoder : public CPUEncoderDecoderBase {
     const Weights& model_;
     std::unique_ptr<Encoder> encoder_;
     std::unique_ptr<Decoder> decoder_;
+
+    // reused by AssembleBeamState
+    std::vector<unsigned> beamWords_;
+    std::vector<unsigned> beamStateIds_;
 };
 
 }
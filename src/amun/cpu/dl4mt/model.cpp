@@ -6,6 +6,18 @@ namespace amunmt {
 namespace CPU {
 namespace dl4mt {
 
+namespace {
+
+// [m1 m2] for the GRUs
+mblas::WeightTensor Concat(const NpzConverter& model, const std::string& name,
+                           const mblas::WeightTensor& m1, const mblas::WeightTensor& m2) {
+  return model.derived(name, [&]() {
+    return mblas::WeightTensor(mblas::Concat<mblas::byColumn, mblas::Tensor>(m1, m2));
+  });
+}
+
+}
+
 Weights::Embeddings::Embeddings(const NpzConverter& model, const std::string &key)
   : E_(model[key])
 {}
@@ -22,18 +34,18 @@ Weights::GRU::GRU(const NpzConverter& model, const std::vector<std::string> &key
     Bx1_(model(keys.at(4), true)),
     Bx2_(Bx1_.rows(), Bx1_.columns()),
     Ux_(model[keys.at(5)]),
-    Gamma_1_(model[keys.at(6)]),
-    Gamma_2_(model[keys.at(7)])
-{
-    const_cast<mblas::Tensor&>(Bx2_) = 0.0f;
-}
+    Gamma_1_(model.row(keys.at(6))),
+    Gamma_2_(model.row(keys.at(7))),
+    WWx_(Concat(model, keys.at(0) + "+" + keys.at(3), W_, Wx_)),
+    UUx_(Concat(model, keys.at(2) + "+" + keys.at(5), U_, Ux_))
+{}
 
 //////////////////////////////////////////////////////////////////////////////
 
 Weights::DecInit::DecInit(const NpzConverter& model)
   : Wi_(model["ff_state_W"]),
     Bi_(model("ff_state_b", true)),
-    Gamma_(model["ff_state_gamma"])
+    Gamma_(model.row("ff_state_gamma"))
 {}
 
 Weights::DecGRU2::DecGRU2(const NpzConverter& model)
@@ -44,11 +56,11 @@ Weights::DecGRU2::DecGRU2(const NpzConverter& model)
   Bx2_(model("decoder_bx_nl", true)),
   Bx1_(Bx2_.rows(), Bx2_.columns()),
   Ux_(model["decoder_Ux_nl"]),
-  Gamma_1_(model["decoder_cell2_gamma1"]),
-  Gamma_2_(model["decoder_cell2_gamma2"])
-{
-    const_cast<mblas::Tensor&>(Bx1_) = 0.0f;
-}
+  Gamma_1_(model.row("decoder_cell2_gamma1")),
+  Gamma_2_(model.row("decoder_cell2_gamma2")),
+  WWx_(Concat(model, "decoder_Wc+decoder_Wcx", W_, Wx_)),
+  UUx_(Concat(model, "decoder_U_nl+decoder_Ux_nl", U_, Ux_))
+{}
 
 Weights::DecAttention::DecAttention(const NpzConverter& model)
 : V_(model("decoder_U_att", true)),
@@ -56,11 +68,11 @@ Weights::DecAttention::DecAttention(const NpzConverter& model)
   B_(model("decoder_b_att", true)),
   U_(model["decoder_Wc_att"]),
   C_(model["decoder_c_tt"]), // scalar?
-  Gamma_1_(model["decoder_att_gamma1"]),
-  Gamma_2_(model["decoder_att_gamma2"])
+  Gamma_1_(model.row("decoder_att_gamma1")),
+  Gamma_2_(model.row("decoder_att_gamma2"))
 {}
 
-Weights::DecSoftmax::DecSoftmax(const NpzConverter& model)
+Weights::DecSoftmax::DecSoftmax(const NpzConverter& model, bool vocabMajor)
 : W1_(model["ff_logit_lstm_W"]),
   B1_(model("ff_logit_lstm_b", true)),
   W2_(model["ff_logit_prev_W"]),
@@ -72,14 +84,15 @@ Weights::DecSoftmax::DecSoftmax(const NpzConverter& model)
                   std::make_pair(std::string("Wemb_dec"),true),
                   std::make_pair(std::string("Wemb"), true)})),
   B4_(model("ff_logit_b", true)),
-  Gamma_0_(model["ff_logit_l1_gamma0"]),
-  Gamma_1_(model["ff_logit_l1_gamma1"]),
-  Gamma_2_(model["ff_logit_l1_gamma2"])
+  Gamma_0_(model.row("ff_logit_l1_gamma0")),
+  Gamma_1_(model.row("ff_logit_l1_gamma1")),
+  Gamma_2_(model.row("ff_logit_l1_gamma2")),
+  W4T_(vocabMajor ? mblas::Transpose<mblas::Tensor>(W4_) : mblas::Tensor())
 {}
 
 //////////////////////////////////////////////////////////////////////////////
 
-Weights::Weights(const NpzConverter& model, size_t)
+Weights::Weights(const NpzConverter& model, size_t, bool vocabMajorOutput)
 : encEmbeddings_(model, "Wemb"),
   encForwardGRU_(model, {"encoder_W", "encoder_b", "encoder_U", "encoder_Wx", "encoder_bx",
                          "encoder_Ux", "encoder_gamma1", "encoder_gamma2"}),
@@ -92,7 +105,7 @@ Weights::Weights(const NpzConverter& model, size_t)
                    "decoder_cell1_gamma1", "decoder_cell1_gamma2"}),
   decGru2_(model),
   decAttention_(model),
-  decSoftmax_(model)
+  decSoftmax_(model, vocabMajorOutput)
 {}
 
 }  // namespace dl4mt
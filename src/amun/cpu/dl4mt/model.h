@@ -19,21 +19,25 @@ struct Weights {
     Embeddings(const NpzConverter& model, const std::string &key);
     Embeddings(const NpzConverter& model, const std::vector<std::pair<std::string, bool>> keys);
 
-    const mblas::Tensor E_;
+    const mblas::WeightTensor E_;
   };
 
   struct GRU {
 	GRU(const NpzConverter& model, const std::vector<std::string> &keys);
 
-    const mblas::Tensor W_;
-    const mblas::Tensor B_;
-    const mblas::Tensor U_;
-    const mblas::Tensor Wx_;
-    const mblas::Tensor Bx1_;
-    const mblas::Tensor Bx2_;
-    const mblas::Tensor Ux_;
-    const mblas::Tensor Gamma_1_;
-    const mblas::Tensor Gamma_2_;
+    const mblas::WeightTensor W_;
+    const mblas::WeightTensor B_;
+    const mblas::WeightTensor U_;
+    const mblas::WeightTensor Wx_;
+    const mblas::WeightTensor Bx1_;
+    const mblas::WeightTensor Bx2_;
+    const mblas::WeightTensor Ux_;
+    const mblas::WeightTensor Gamma_1_;
+    const mblas::WeightTensor Gamma_2_;
+
+    // [W_ Wx_] and [U_ Ux_], which the GRUs of all threads multiply by
+    const mblas::WeightTensor WWx_;
+    const mblas::WeightTensor UUx_;
   };
 
   //////////////////////////////////////////////////////////////////////////////
@@ -41,60 +45,69 @@ struct Weights {
   struct DecInit {
     DecInit(const NpzConverter& model);
 
-    const mblas::Tensor Wi_;
-    const mblas::Tensor Bi_;
-    const mblas::Tensor Gamma_;
+    const mblas::WeightTensor Wi_;
+    const mblas::WeightTensor Bi_;
+    const mblas::WeightTensor Gamma_;
   };
 
   struct DecGRU2 {
     DecGRU2(const NpzConverter& model);
 
-    const mblas::Tensor W_;
-    const mblas::Tensor B_;
-    const mblas::Tensor U_;
-    const mblas::Tensor Wx_;
-    const mblas::Tensor Bx2_;
-    const mblas::Tensor Bx1_;
-    const mblas::Tensor Ux_;
-    const mblas::Tensor Gamma_1_;
-    const mblas::Tensor Gamma_2_;
+    const mblas::WeightTensor W_;
+    const mblas::WeightTensor B_;
+    const mblas::WeightTensor U_;
+    const mblas::WeightTensor Wx_;
+    const mblas::WeightTensor Bx2_;
+    const mblas::WeightTensor Bx1_;
+    const mblas::WeightTensor Ux_;
+    const mblas::WeightTensor Gamma_1_;
+    const mblas::WeightTensor Gamma_2_;
+
+    // [W_ Wx_] and [U_ Ux_], which the GRUs of all threads multiply by
+    const mblas::WeightTensor WWx_;
+    const mblas::WeightTensor UUx_;
   };
 
   struct DecAttention {
     DecAttention(const NpzConverter& model);
 
-    const mblas::Tensor V_;
-    const mblas::Tensor W_;
-    const mblas::Tensor B_;
-    const mblas::Tensor U_;
-    const mblas::Tensor C_;
-    const mblas::Tensor Gamma_1_;
-    const mblas::Tensor Gamma_2_;
+    const mblas::WeightTensor V_;
+    const mblas::WeightTensor W_;
+    const mblas::WeightTensor B_;
+    const mblas::WeightTensor U_;
+    const mblas::WeightTensor C_;
+    const mblas::WeightTensor Gamma_1_;
+    const mblas::WeightTensor Gamma_2_;
   };
 
   struct DecSoftmax {
-    DecSoftmax(const NpzConverter& model);
-
-    const mblas::Tensor W1_;
-    const mblas::Tensor B1_;
-    const mblas::Tensor W2_;
-    const mblas::Tensor B2_;
-    const mblas::Tensor W3_;
-    const mblas::Tensor B3_;
-    const mblas::Tensor W4_;
-    const mblas::Tensor B4_;
-    const mblas::Tensor Gamma_0_;
-    const mblas::Tensor Gamma_1_;
-    const mblas::Tensor Gamma_2_;
+    DecSoftmax(const NpzConverter& model, bool vocabMajor);
+
+    const mblas::WeightTensor W1_;
+    const mblas::WeightTensor B1_;
+    const mblas::WeightTensor W2_;
+    const mblas::WeightTensor B2_;
+    const mblas::WeightTensor W3_;
+    const mblas::WeightTensor B3_;
+    const mblas::WeightTensor W4_;
+    const mblas::WeightTensor B4_;
+    const mblas::WeightTensor Gamma_0_;
+    const mblas::WeightTensor Gamma_1_;
+    const mblas::WeightTensor Gamma_2_;
+
+    // vocab-major copy of W4_ for --softmax-filter, empty if not requested
+    const mblas::Tensor W4T_;
   };
 
   //////////////////////////////////////////////////////////////////////////////
 
-  Weights(const std::string& npzFile, size_t device = 0)
-    : Weights(NpzConverter(npzFile), device)
+  Weights(const std::string& npzFile, size_t device = 0, bool vocabMajorOutput = false)
+    : Weights(NpzConverter(npzFile), device, vocabMajorOutput)
   {}
 
-  Weights(const NpzConverter& model, size_t device = 0);
+  // vocabMajorOutput: also keep the transpose of the output layer, whose
+  // shortlisted rows are gathered faster than the columns of W4_
+  Weights(const NpzConverter& model, size_t device = 0, bool vocabMajorOutput = false);
 
   size_t GetDevice() {
     return std::numeric_limits<size_t>::max();
@@ -57,24 +57,12 @@ class Transition {
       using namespace mblas;
       using namespace blaze;
 
+      // biases B_ and Bx1_ are already added to Temp_1_ and Temp_2_
       for (int j = 0; j < (int)state.Rows(); ++j) {
-        auto rowState = row(state, j);
-        auto rowT   = row(Temp_1_, j);
-        auto rowT2  = row(Temp_2_, j);
-
-        for (int i = 0; i < (int)state.Cols(); ++i) {
-          float ev1 = expapprox(-(rowT[i])); // + w_.B_[idx](0, i)));
-          float r = 1.0f / (1.0f + ev1);
-
-          int k = i + state.Cols();
-          float ev2 = expapprox(-(rowT[k])); // + w_.B_[idx](0, k)));
-          float u = 1.0f / (1.0f + ev2);
-
-          float hv = w_.Bx2_[idx](0, i);
-          float t2v = rowT2[i]; // + w_.Bx1_[idx](0, i);
-          hv = tanhapprox(hv + r * t2v);
-          rowState[i] = (1.0f - u) * hv + u * rowState[i];
-        }
+        simd::GRUUpdate(&state(j, 0), &state(j, 0),
+                        &Temp_1_(j, 0), nullptr, nullptr,
+                        nullptr, &w_.Bx2_[idx](0, 0),
+                        &Temp_2_(j, 0), nullptr, state.Cols());
       }
     }
 
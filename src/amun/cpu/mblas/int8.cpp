@@ -0,0 +1,153 @@
+#include "cpu/mblas/int8.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+namespace {
+
+const unsigned ALIGN = 32;
+
+unsigned PaddedLength(unsigned length) {
+  return (length + ALIGN - 1) / ALIGN * ALIGN;
+}
+
+// Quantizes length values with step size 1/invScale into [-127, 127], so the
+// sign trick below never meets -128.
+void Quantize(int8_t* out, const float* in, unsigned length, unsigned step, float invScale) {
+  for (unsigned i = 0; i < length; ++i) {
+    float v = std::round(in[i * step] * invScale);
+    out[i] = (int8_t) std::max(-127.0f, std::min(127.0f, v));
+  }
+}
+
+// n is a multiple of ALIGN
+inline int32_t Dot(const int8_t* a, const int8_t* b, unsigned n) {
+#ifdef __AVX2__
+  __m256i acc = _mm256_setzero_si256();
+#if !(defined(__AVX512VNNI__) && defined(__AVX512VL__))
+  const __m256i ones = _mm256_set1_epi16(1);
+#endif
+  for (unsigned i = 0; i < n; i += ALIGN) {
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+    // unsigned x signed multiply: move the sign of a onto b
+    __m256i absA = _mm256_sign_epi8(va, va);
+    __m256i signB = _mm256_sign_epi8(vb, va);
+#if defined(__AVX512VNNI__) && defined(__AVX512VL__)
+    acc = _mm256_dpbusd_epi32(acc, absA, signB);
+#else
+    // 2 * 127 * 127 fits into int16, maddubs does not saturate
+    acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_maddubs_epi16(absA, signB), ones));
+#endif
+  }
+  __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+  sum = _mm_hadd_epi32(sum, sum);
+  sum = _mm_hadd_epi32(sum, sum);
+  return _mm_cvtsi128_si32(sum);
+#else
+  int32_t sum = 0;
+  for (unsigned i = 0; i < n; ++i) {
+    sum += (int32_t) a[i] * (int32_t) b[i];
+  }
+  return sum;
+#endif
+}
+
+void Prod(float* out, unsigned outStride,
+          const float* in, unsigned inStride, unsigned rows,
+          const QuantizedTensor& W)
+{
+  const unsigned stride = W.stride();
+
+  // reused to avoid allocation
+  thread_local std::vector<int8_t> A;
+  thread_local std::vector<float> scales;
+  A.assign(rows * stride, 0);
+  scales.resize(rows);
+
+  for (unsigned j = 0; j < rows; ++j) {
+    const float* rowIn = in + j * inStride;
+    float maxAbs = 0.0f;
+    for (unsigned k = 0; k < W.rows(); ++k) {
+      maxAbs = std::max(maxAbs, std::abs(rowIn[k]));
+    }
+    scales[j] = maxAbs / 127.0f;
+    Quantize(A.data() + j * stride, rowIn, W.rows(), 1, maxAbs > 0.0f ? 127.0f / maxAbs : 0.0f);
+  }
+
+  // columns of W outermost, every column is read from memory only once
+  for (unsigned i = 0; i < W.columns(); ++i) {
+    const int8_t* col = W.column(i);
+    const float scale = W.scale(i);
+    for (unsigned j = 0; j < rows; ++j) {
+      out[j * outStride + i] = Dot(A.data() + j * stride, col, stride) * scales[j] * scale;
+    }
+  }
+}
+
+}
+
+QuantizedTensor::QuantizedTensor(const WeightTensor& W)
+  : rows_(W.rows()),
+    columns_(W.columns()),
+    stride_(PaddedLength(W.rows())),
+    data_(columns_ * stride_, 0),
+    scales_(columns_)
+{
+  for (unsigned i = 0; i < columns_; ++i) {
+    float maxAbs = 0.0f;
+    for (unsigned k = 0; k < rows_; ++k) {
+      maxAbs = std::max(maxAbs, std::abs(W(k, i)));
+    }
+    scales_[i] = maxAbs / 127.0f;
+    Quantize(data_.data() + i * stride_, W.data() + i, rows_, W.spacing(),
+             maxAbs > 0.0f ? 127.0f / maxAbs : 0.0f);
+  }
+}
+
+QuantizedTensor::QuantizedTensor(const QuantizedTensor& W, const std::vector<unsigned>& ids)
+  : rows_(W.rows_),
+    columns_(ids.size()),
+    stride_(W.stride_),
+    data_(columns_ * stride_),
+    scales_(columns_)
+{
+  for (unsigned i = 0; i < columns_; ++i) {
+    std::copy(W.column(ids[i]), W.column(ids[i]) + stride_, data_.begin() + i * stride_);
+    scales_[i] = W.scales_[ids[i]];
+  }
+}
+
+QuantizedTensor Concat(const QuantizedTensor& m1, const QuantizedTensor& m2) {
+  assert(m1.rows_ == m2.rows_);
+  QuantizedTensor out = m1;
+  out.columns_ += m2.columns_;
+  out.data_.insert(out.data_.end(), m2.data_.begin(), m2.data_.end());
+  out.scales_.insert(out.scales_.end(), m2.scales_.begin(), m2.scales_.end());
+  return out;
+}
+
+void Prod(Tensor& Out, const Tensor& In, const QuantizedTensor& W) {
+  assert(In.columns() == W.rows());
+  Out.resize(In.rows(), W.columns(), false);
+  Prod(Out.data(), Out.spacing(), In.data(), In.spacing(), In.rows(), W);
+}
+
+void Prod(ArrayMatrix& Out, const Tensor& In, const QuantizedTensor& W) {
+  assert(In.columns() == W.rows());
+  Out.Resize(In.rows(), W.columns());
+  Prod(Out.data(), Out.columns(), In.data(), In.spacing(), In.rows(), W);
+}
+
+}
+}
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "cpu/mblas/tensor.h"
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+// Weight matrix quantized to int8 with one scale per column (--cpu-int8).
+// It is stored transposed, each column padded with zeros to a multiple of 32,
+// so that every output value of a product is one contiguous dot product.
+class QuantizedTensor {
+  public:
+    QuantizedTensor() {}
+
+    explicit QuantizedTensor(const WeightTensor& W);
+
+    // columns ids of W, e.g. a filtered output layer
+    QuantizedTensor(const QuantizedTensor& W, const std::vector<unsigned>& ids);
+
+    unsigned rows() const {
+      return rows_;
+    }
+
+    unsigned columns() const {
+      return columns_;
+    }
+
+    bool empty() const {
+      return columns_ == 0;
+    }
+
+    const int8_t* column(unsigned i) const {
+      return data_.data() + i * stride_;
+    }
+
+    float scale(unsigned i) const {
+      return scales_[i];
+    }
+
+    unsigned stride() const {
+      return stride_;
+    }
+
+    size_t bytes() const {
+      return data_.size() + scales_.size() * sizeof(float);
+    }
+
+    friend QuantizedTensor Concat(const QuantizedTensor& m1, const QuantizedTensor& m2);
+
+  private:
+    unsigned rows_ = 0;
+    unsigned columns_ = 0;
+    unsigned stride_ = 0;
+    std::vector<int8_t> data_;
+    std::vector<float> scales_;
+};
+
+// concatenation by column
+QuantizedTensor Concat(const QuantizedTensor& m1, const QuantizedTensor& m2);
+
+// Out = In * W. Rows of In are quantized on the fly with one scale per row,
+// products are accumulated in int32.
+void Prod(Tensor& Out, const Tensor& In, const QuantizedTensor& W);
+void Prod(ArrayMatrix& Out, const Tensor& In, const QuantizedTensor& W);
+
+}
+}
+}
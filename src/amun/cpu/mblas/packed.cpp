@@ -0,0 +1,223 @@
+#include "cpu/mblas/packed.h"
+
+#include <algorithm>
+#include <cassert>
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+namespace {
+
+const unsigned PANEL = PanelTensor::PANEL;
+
+// rows of In per micro kernel, ROWS x PANEL accumulators stay in registers
+const unsigned ROWS = 4;
+
+unsigned NumPanels(unsigned columns) {
+  return (columns + PANEL - 1) / PANEL;
+}
+
+void Prod(float* out, unsigned outStride,
+          const float* in, unsigned inStride, unsigned rows,
+          const PanelTensor& W)
+{
+  const unsigned depth = W.rows();
+
+  // panels outermost, every panel is read from memory only once
+  for (unsigned p = 0; p < NumPanels(W.columns()); ++p) {
+    const float* panel = W.panel(p);
+    const unsigned cols = std::min(PANEL, W.columns() - p * PANEL);
+
+    for (unsigned j = 0; j < rows; j += ROWS) {
+      // a short last block repeats its last row instead of branching
+      const float* rowIn[ROWS];
+      for (unsigned r = 0; r < ROWS; ++r) {
+        rowIn[r] = in + std::min(j + r, rows - 1) * inStride;
+      }
+
+      float acc[ROWS][PANEL];
+#ifdef __AVX__
+      // a panel row is two aligned AVX registers
+      __m256 sum[ROWS][2];
+      for (unsigned r = 0; r < ROWS; ++r) {
+        sum[r][0] = _mm256_setzero_ps();
+        sum[r][1] = _mm256_setzero_ps();
+      }
+      for (unsigned k = 0; k < depth; ++k) {
+        const __m256 w0 = _mm256_load_ps(panel + k * PANEL);
+        const __m256 w1 = _mm256_load_ps(panel + k * PANEL + 8);
+        for (unsigned r = 0; r < ROWS; ++r) {
+          const __m256 a = _mm256_broadcast_ss(rowIn[r] + k);
+#ifdef __FMA__
+          sum[r][0] = _mm256_fmadd_ps(a, w0, sum[r][0]);
+          sum[r][1] = _mm256_fmadd_ps(a, w1, sum[r][1]);
+#else
+          sum[r][0] = _mm256_add_ps(sum[r][0], _mm256_mul_ps(a, w0));
+          sum[r][1] = _mm256_add_ps(sum[r][1], _mm256_mul_ps(a, w1));
+#endif
+        }
+      }
+      for (unsigned r = 0; r < ROWS; ++r) {
+        _mm256_storeu_ps(acc[r], sum[r][0]);
+        _mm256_storeu_ps(acc[r] + 8, sum[r][1]);
+      }
+#else
+      std::fill(&acc[0][0], &acc[0][0] + ROWS * PANEL, 0.0f);
+      for (unsigned k = 0; k < depth; ++k) {
+        const float* rowW = panel + k * PANEL;
+        for (unsigned r = 0; r < ROWS; ++r) {
+          const float a = rowIn[r][k];
+          for (unsigned n = 0; n < PANEL; ++n) {
+            acc[r][n] += a * rowW[n];
+          }
+        }
+      }
+#endif
+
+      for (unsigned r = 0; r < ROWS && j + r < rows; ++r) {
+        std::copy(acc[r], acc[r] + cols, out + (j + r) * outStride + p * PANEL);
+      }
+    }
+  }
+}
+
+}
+
+PanelTensor::PanelTensor(const WeightTensor& W)
+  : rows_(W.rows()),
+    columns_(W.columns()),
+    data_(NumPanels(columns_) * rows_ * PANEL, 0.0f)
+{
+  for (unsigned k = 0; k < rows_; ++k) {
+    for (unsigned i = 0; i < columns_; ++i) {
+      data_[(i / PANEL) * rows_ * PANEL + k * PANEL + i % PANEL] = W(k, i);
+    }
+  }
+}
+
+PanelTensor::PanelTensor(const PanelTensor& W, const std::vector<unsigned>& ids)
+  : rows_(W.rows_),
+    columns_(ids.size()),
+    data_(NumPanels(columns_) * rows_ * PANEL, 0.0f)
+{
+  for (unsigned i = 0; i < columns_; ++i) {
+    Gather(W, i, ids[i]);
+  }
+}
+
+PanelTensor::PanelTensor(const Tensor& Wt, const std::vector<unsigned>& ids)
+  : rows_(Wt.columns()),
+    columns_(ids.size()),
+    data_(NumPanels(columns_) * rows_ * PANEL, 0.0f)
+{
+  // the rows of Wt of one panel are read side by side
+  const float* from[PANEL];
+  for (unsigned p = 0; p < NumPanels(columns_); ++p) {
+    unsigned n = std::min(PANEL, columns_ - p * PANEL);
+    for (unsigned i = 0; i < n; ++i) {
+      from[i] = &Wt(ids[p * PANEL + i], 0);
+    }
+    float* dest = data_.data() + p * rows_ * PANEL;
+    for (unsigned k = 0; k < rows_; ++k, dest += PANEL) {
+      for (unsigned i = 0; i < n; ++i) {
+        dest[i] = from[i][k];
+      }
+    }
+  }
+}
+
+void PanelTensor::Gather(const PanelTensor& W, unsigned i, unsigned from) {
+  float* dest = data_.data() + (i / PANEL) * rows_ * PANEL + i % PANEL;
+  for (unsigned k = 0; k < rows_; ++k) {
+    dest[k * PANEL] = W(k, from);
+  }
+}
+
+PanelTensor Concat(const PanelTensor& m1, const PanelTensor& m2) {
+  assert(m1.rows_ == m2.rows_);
+  PanelTensor out;
+  out.rows_ = m1.rows_;
+  out.columns_ = m1.columns_ + m2.columns_;
+  out.data_.assign(NumPanels(out.columns_) * out.rows_ * PANEL, 0.0f);
+  for (unsigned i = 0; i < m1.columns_; ++i) {
+    out.Gather(m1, i, i);
+  }
+  for (unsigned i = 0; i < m2.columns_; ++i) {
+    out.Gather(m2, m1.columns_ + i, i);
+  }
+  return out;
+}
+
+void Prod(Tensor& Out, const Tensor& In, const PanelTensor& W) {
+  assert(In.columns() == W.rows());
+  Out.resize(In.rows(), W.columns(), false);
+  Prod(Out.data(), Out.spacing(), In.data(), In.spacing(), In.rows(), W);
+}
+
+void Prod(ArrayMatrix& Out, const Tensor& In, const PanelTensor& W) {
+  assert(In.columns() == W.rows());
+  Out.Resize(In.rows(), W.columns());
+  Prod(Out.data(), Out.columns(), In.data(), In.spacing(), In.rows(), W);
+}
+
+PackedTensor::PackedTensor(const WeightTensor& W, WeightLayout layout)
+  // matrices of missing optional weights stay empty
+  : layout_(W.columns() ? layout : WeightLayout::Blaze)
+{
+  switch (layout_) {
+    case WeightLayout::Panels:
+      panels_ = PanelTensor(W);
+      break;
+    case WeightLayout::Int8:
+      int8_ = QuantizedTensor(W);
+      break;
+    case WeightLayout::Blaze:
+      break;
+  }
+}
+
+PackedTensor::PackedTensor(const PackedTensor& W, const std::vector<unsigned>& ids,
+                           const Tensor& Wt)
+  : layout_(W.layout_)
+{
+  switch (layout_) {
+    case WeightLayout::Panels:
+      if (Wt.rows() > 0) {
+        panels_ = PanelTensor(Wt, ids);
+      } else {
+        panels_ = PanelTensor(W.panels_, ids);
+      }
+      break;
+    case WeightLayout::Int8:
+      int8_ = QuantizedTensor(W.int8_, ids);
+      break;
+    case WeightLayout::Blaze:
+      break;
+  }
+}
+
+PackedTensor Concat(const PackedTensor& m1, const PackedTensor& m2) {
+  assert(m1.layout_ == m2.layout_);
+  PackedTensor out;
+  out.layout_ = m1.layout_;
+  switch (out.layout_) {
+    case WeightLayout::Panels:
+      out.panels_ = Concat(m1.panels_, m2.panels_);
+      break;
+    case WeightLayout::Int8:
+      out.int8_ = Concat(m1.int8_, m2.int8_);
+      break;
+    case WeightLayout::Blaze:
+      break;
+  }
+  return out;
+}
+
+}
+}
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "cpu/mblas/tensor.h"
+#include "cpu/mblas/int8.h"
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+// Storage layout of the weight matrices W in the products In * W, chosen at
+// load time.
+//   Blaze:  the plain Tensor
+//   Panels: fp32 GEMM panels, --cpu-packed-weights
+//   Int8:   int8 columns, --cpu-int8
+enum class WeightLayout { Blaze, Panels, Int8 };
+
+template <class T, size_t Alignment>
+struct AlignedAllocator {
+  typedef T value_type;
+
+  template <class U>
+  struct rebind {
+    typedef AlignedAllocator<U, Alignment> other;
+  };
+
+  AlignedAllocator() {}
+
+  template <class U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+  T* allocate(size_t n) {
+    size_t bytes = (n * sizeof(T) + Alignment - 1) / Alignment * Alignment;
+    void* ptr = aligned_alloc(Alignment, bytes);
+    if (!ptr) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T*>(ptr);
+  }
+
+  void deallocate(T* ptr, size_t) {
+    free(ptr);
+  }
+
+  template <class U>
+  bool operator==(const AlignedAllocator<U, Alignment>&) const {
+    return true;
+  }
+
+  template <class U>
+  bool operator!=(const AlignedAllocator<U, Alignment>&) const {
+    return false;
+  }
+};
+
+// fp32 weight matrix repacked into panels of PANEL columns. A panel holds
+// rows() cache lines of PANEL values, one per row of W, so a product streams
+// every panel contiguously. Panels are 64-byte aligned, the last one is padded
+// with zero columns.
+class PanelTensor {
+  public:
+    static const unsigned PANEL = 16;
+
+    PanelTensor() {}
+
+    explicit PanelTensor(const WeightTensor& W);
+
+    // columns ids of W, e.g. a filtered output layer
+    PanelTensor(const PanelTensor& W, const std::vector<unsigned>& ids);
+
+    // the same from the transpose Wt of W, whose rows are contiguous
+    PanelTensor(const Tensor& Wt, const std::vector<unsigned>& ids);
+
+    unsigned rows() const {
+      return rows_;
+    }
+
+    unsigned columns() const {
+      return columns_;
+    }
+
+    const float* panel(unsigned p) const {
+      return data_.data() + p * rows_ * PANEL;
+    }
+
+    float operator()(unsigned k, unsigned i) const {
+      return panel(i / PANEL)[k * PANEL + i % PANEL];
+    }
+
+    size_t bytes() const {
+      return data_.size() * sizeof(float);
+    }
+
+    friend PanelTensor Concat(const PanelTensor& m1, const PanelTensor& m2);
+
+  private:
+    void Gather(const PanelTensor& W, unsigned i, unsigned from);
+
+    unsigned rows_ = 0;
+    unsigned columns_ = 0;
+    std::vector<float, AlignedAllocator<float, 64>> data_;
+};
+
+// concatenation by column
+PanelTensor Concat(const PanelTensor& m1, const PanelTensor& m2);
+
+void Prod(Tensor& Out, const Tensor& In, const PanelTensor& W);
+void Prod(ArrayMatrix& Out, const Tensor& In, const PanelTensor& W);
+
+// Copy of a weight matrix in the layout used for its products, empty for
+// WeightLayout::Blaze.
+class PackedTensor {
+  public:
+    PackedTensor() {}
+
+    PackedTensor(const WeightTensor& W, WeightLayout layout);
+
+    // columns ids of W, e.g. a filtered output layer. Panels are gathered from
+    // the transpose Wt of W instead if it is not empty.
+    PackedTensor(const PackedTensor& W, const std::vector<unsigned>& ids,
+                 const Tensor& Wt = Tensor());
+
+    bool empty() const {
+      return layout_ == WeightLayout::Blaze;
+    }
+
+    size_t bytes() const {
+      return panels_.bytes() + int8_.bytes();
+    }
+
+    friend PackedTensor Concat(const PackedTensor& m1, const PackedTensor& m2);
+
+    template <class MT>
+    friend void Prod(MT& Out, const Tensor& In, const PackedTensor& W);
+
+  private:
+    WeightLayout layout_ = WeightLayout::Blaze;
+    PanelTensor panels_;
+    QuantizedTensor int8_;
+};
+
+// concatenation by column
+PackedTensor Concat(const PackedTensor& m1, const PackedTensor& m2);
+
+template <class MT>
+void Prod(MT& Out, const Tensor& In, const PackedTensor& W) {
+  if (W.layout_ == WeightLayout::Int8) {
+    Prod(Out, In, W.int8_);
+  } else {
+    Prod(Out, In, W.panels_);
+  }
+}
+
+// Out = In * W, through the packed copy of W if there is one
+template <class MT, class WT>
+void Prod(MT& Out, const Tensor& In, const WT& W, const PackedTensor& Wp) {
+  if (Wp.empty()) {
+    Out = In * W;
+  } else {
+    Prod(Out, In, Wp);
+  }
+}
+
+}
+}
+}
@@ -0,0 +1,83 @@
+#include "cpu/mblas/simd_functions.h"
+#include "cpu/mblas/simd_kernels.h"
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+namespace simd {
+
+Functions ScalarFunctions() {
+  return MakeFunctions<Scalar>("scalar");
+}
+
+namespace {
+
+Functions Select() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return Avx512Functions();
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return Avx2Functions();
+  }
+  return ScalarFunctions();
+}
+
+const Functions& Dispatch() {
+  static const Functions functions = Select();
+  return functions;
+}
+
+}
+
+const char* InstructionSet() {
+  return Dispatch().name;
+}
+
+void Exp(float* out, const float* in, unsigned n) {
+  Dispatch().exp(out, in, n);
+}
+
+void Log(float* out, const float* in, unsigned n) {
+  Dispatch().log(out, in, n);
+}
+
+void Tanh(float* out, const float* in, unsigned n) {
+  Dispatch().tanh(out, in, n);
+}
+
+void TanhSum(float* out, const float* a, const float* b, unsigned n) {
+  Dispatch().tanhSum(out, a, b, n);
+}
+
+float TanhSumDot(const float* a, const float* b, const float* v, unsigned n) {
+  return Dispatch().tanhSumDot(a, b, v, n);
+}
+
+float SumExp(const float* in, unsigned n, float shift) {
+  return Dispatch().sumExp(in, n, shift);
+}
+
+float ExpAndSum(float* out, const float* in, unsigned n, float shift) {
+  return Dispatch().expAndSum(out, in, n, shift);
+}
+
+void GRUUpdate(float* out, const float* state,
+               const float* x, const float* y, const float* b,
+               const float* h, const float* bh,
+               const float* t, const float* bt, unsigned n)
+{
+  Dispatch().gruUpdate(out, state, x, y, b, h, bh, t, bt, n);
+}
+
+void LayerNormalization(float* row, const float* bias,
+                        const float* gamma, const float* beta,
+                        unsigned n, float eps)
+{
+  Dispatch().layerNormalization(row, bias, gamma, beta, n, eps);
+}
+
+}
+}
+}
+}
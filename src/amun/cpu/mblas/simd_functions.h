@@ -0,0 +1,59 @@
+#pragma once
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+// Vector versions of expapprox, logapprox and tanhapprox (phoenix_functions.h)
+// over contiguous rows of n floats. The AVX-512 (16 wide) or AVX2 (8 wide)
+// implementation is chosen once from CPUID, the scalar one is the fallback.
+// out may be the same row as an input.
+namespace simd {
+
+// name of the chosen instruction set: "avx512", "avx2" or "scalar"
+const char* InstructionSet();
+
+// out[i] = exp(in[i])
+void Exp(float* out, const float* in, unsigned n);
+
+// out[i] = log(in[i])
+void Log(float* out, const float* in, unsigned n);
+
+// out[i] = tanh(in[i])
+void Tanh(float* out, const float* in, unsigned n);
+
+// out[i] = tanh(a[i] + b[i])
+void TanhSum(float* out, const float* a, const float* b, unsigned n);
+
+// returns sum_i v[i] * tanh(a[i] + b[i])
+float TanhSumDot(const float* a, const float* b, const float* v, unsigned n);
+
+// returns sum_i exp(in[i] - shift)
+float SumExp(const float* in, unsigned n, float shift);
+
+// out[i] = exp(in[i] - shift), returns sum_i out[i]
+float ExpAndSum(float* out, const float* in, unsigned n, float shift);
+
+// Gated update of one GRU row of n units, null operands are zero:
+//   r = sigmoid(x[i] + y[i] + b[i])
+//   u = sigmoid(x[n + i] + y[n + i] + b[n + i])
+//   out[i] = (1 - u) * tanh(h[i] + bh[i] + r * (t[i] + bt[i])) + u * state[i]
+void GRUUpdate(float* out, const float* state,
+               const float* x, const float* y, const float* b,
+               const float* h, const float* bh,
+               const float* t, const float* bt, unsigned n);
+
+// Layer normalization of one row of n values, in place, optionally fused
+// with the bias before it:
+//   x = row + bias
+//   row[i] = gamma[i] * (x[i] - mean(x)) / sqrt(var(x) + eps) + beta[i]
+// Mean and variance are taken in a single pass. bias and beta may be null.
+void LayerNormalization(float* row, const float* bias,
+                        const float* gamma, const float* beta,
+                        unsigned n, float eps);
+
+}
+
+}
+}
+}
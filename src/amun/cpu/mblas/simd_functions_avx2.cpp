@@ -0,0 +1,59 @@
+// Compiled with -mavx2 -mfma, only called if the CPU has both.
+#include <immintrin.h>
+
+#include "cpu/mblas/simd_kernels.h"
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+namespace simd {
+
+namespace {
+
+struct Avx2 {
+  typedef __m256 type;
+  typedef __m256i itype;
+  static const unsigned N = 8;
+
+  static type Load(const float* p) { return _mm256_loadu_ps(p); }
+  static void Store(float* p, type a) { _mm256_storeu_ps(p, a); }
+  static type Set1(float a) { return _mm256_set1_ps(a); }
+  static type Add(type a, type b) { return _mm256_add_ps(a, b); }
+  static type Sub(type a, type b) { return _mm256_sub_ps(a, b); }
+  static type Mul(type a, type b) { return _mm256_mul_ps(a, b); }
+  static type Div(type a, type b) { return _mm256_div_ps(a, b); }
+  static type Min(type a, type b) { return _mm256_min_ps(a, b); }
+  static type Max(type a, type b) { return _mm256_max_ps(a, b); }
+  static type Fmadd(type a, type b, type c) { return _mm256_fmadd_ps(a, b, c); }
+
+  static float Sum(type a) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+  }
+
+  static itype Cvtt(type a) { return _mm256_cvttps_epi32(a); }
+  static itype AndI(itype a, int c) { return _mm256_and_si256(a, _mm256_set1_epi32(c)); }
+  static itype OrI(itype a, int c) { return _mm256_or_si256(a, _mm256_set1_epi32(c)); }
+  static itype Sra23(itype a) { return _mm256_srai_epi32(a, 23); }
+  static type ToFloat(itype a) { return _mm256_cvtepi32_ps(a); }
+  static type AsFloat(itype a) { return _mm256_castsi256_ps(a); }
+  static itype AsInt(type a) { return _mm256_castps_si256(a); }
+
+  static type IfPositive(type x, float a, float b) {
+    type mask = _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_GT_OQ);
+    return _mm256_blendv_ps(Set1(b), Set1(a), mask);
+  }
+};
+
+}
+
+Functions Avx2Functions() {
+  return MakeFunctions<Avx2>("avx2");
+}
+
+}
+}
+}
+}
@@ -0,0 +1,53 @@
+// Compiled with -mavx512f, only called if the CPU has it.
+#include <immintrin.h>
+
+#include "cpu/mblas/simd_kernels.h"
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+namespace simd {
+
+namespace {
+
+struct Avx512 {
+  typedef __m512 type;
+  typedef __m512i itype;
+  static const unsigned N = 16;
+
+  static type Load(const float* p) { return _mm512_loadu_ps(p); }
+  static void Store(float* p, type a) { _mm512_storeu_ps(p, a); }
+  static type Set1(float a) { return _mm512_set1_ps(a); }
+  static type Add(type a, type b) { return _mm512_add_ps(a, b); }
+  static type Sub(type a, type b) { return _mm512_sub_ps(a, b); }
+  static type Mul(type a, type b) { return _mm512_mul_ps(a, b); }
+  static type Div(type a, type b) { return _mm512_div_ps(a, b); }
+  static type Min(type a, type b) { return _mm512_min_ps(a, b); }
+  static type Max(type a, type b) { return _mm512_max_ps(a, b); }
+  static type Fmadd(type a, type b, type c) { return _mm512_fmadd_ps(a, b, c); }
+  static float Sum(type a) { return _mm512_reduce_add_ps(a); }
+
+  static itype Cvtt(type a) { return _mm512_cvttps_epi32(a); }
+  static itype AndI(itype a, int c) { return _mm512_and_si512(a, _mm512_set1_epi32(c)); }
+  static itype OrI(itype a, int c) { return _mm512_or_si512(a, _mm512_set1_epi32(c)); }
+  static itype Sra23(itype a) { return _mm512_srai_epi32(a, 23); }
+  static type ToFloat(itype a) { return _mm512_cvtepi32_ps(a); }
+  static type AsFloat(itype a) { return _mm512_castsi512_ps(a); }
+  static itype AsInt(type a) { return _mm512_castps_si512(a); }
+
+  static type IfPositive(type x, float a, float b) {
+    __mmask16 mask = _mm512_cmp_ps_mask(x, _mm512_setzero_ps(), _CMP_GT_OQ);
+    return _mm512_mask_blend_ps(mask, Set1(b), Set1(a));
+  }
+};
+
+}
+
+Functions Avx512Functions() {
+  return MakeFunctions<Avx512>("avx512");
+}
+
+}
+}
+}
+}
@@ -0,0 +1,345 @@
+#pragma once
+
+// Kernels behind simd_functions.h, written once against a vector type V:
+//   typedef type, itype; N lanes; Load/Store/Set1/Add/Sub/Mul/Div/Min/Max,
+//   Fmadd(a, b, c) = a * b + c, Sum (horizontal), Cvtt (truncate to int),
+//   AndI/OrI with a constant, Sra23, ToFloat, AsFloat/AsInt (bit casts) and
+//   IfPositive(x, a, b) = x > 0 ? a : b.
+// Every instruction set compiles this header in its own translation unit with
+// its own flags. Everything here has internal linkage, so the linker can never
+// pick e.g. the AVX-512 copy of a helper for the AVX2 code.
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+namespace simd {
+
+// what one instruction set provides, see simd_functions.h for the semantics
+struct Functions {
+  const char* name;
+  void (*exp)(float* out, const float* in, unsigned n);
+  void (*log)(float* out, const float* in, unsigned n);
+  void (*tanh)(float* out, const float* in, unsigned n);
+  float (*sumExp)(const float* in, unsigned n, float shift);
+  float (*expAndSum)(float* out, const float* in, unsigned n, float shift);
+  void (*tanhSum)(float* out, const float* a, const float* b, unsigned n);
+  float (*tanhSumDot)(const float* a, const float* b, const float* v, unsigned n);
+  void (*gruUpdate)(float* out, const float* state,
+                    const float* x, const float* y, const float* b,
+                    const float* h, const float* bh,
+                    const float* t, const float* bt, unsigned n);
+  void (*layerNormalization)(float* row, const float* bias,
+                             const float* gamma, const float* beta,
+                             unsigned n, float eps);
+};
+
+Functions ScalarFunctions();
+Functions Avx2Functions();
+Functions Avx512Functions();
+
+namespace {
+
+// one lane, for the fallback and for the tails of the vector loops
+struct Scalar {
+  typedef float type;
+  typedef int itype;
+  static const unsigned N = 1;
+
+  static type Load(const float* p) { return *p; }
+  static void Store(float* p, type a) { *p = a; }
+  static type Set1(float a) { return a; }
+  static type Add(type a, type b) { return a + b; }
+  static type Sub(type a, type b) { return a - b; }
+  static type Mul(type a, type b) { return a * b; }
+  static type Div(type a, type b) { return a / b; }
+  static type Min(type a, type b) { return a < b ? a : b; }
+  static type Max(type a, type b) { return a > b ? a : b; }
+  static type Fmadd(type a, type b, type c) { return a * b + c; }
+  static float Sum(type a) { return a; }
+
+  static itype Cvtt(type a) { return (int) a; }
+  static itype AndI(itype a, int c) { return a & c; }
+  static itype OrI(itype a, int c) { return a | c; }
+  static itype Sra23(itype a) { return a >> 23; }
+  static type ToFloat(itype a) { return (float) a; }
+  static type AsFloat(itype a) { union { int i; float f; } u; u.i = a; return u.f; }
+  static itype AsInt(type a) { union { float f; int i; } u; u.f = a; return u.i; }
+  static type IfPositive(type x, float a, float b) { return x > 0 ? a : b; }
+};
+
+// The approximations of phoenix_functions.h, lane by lane
+
+template <class V>
+typename V::type ExpApprox(typename V::type val) {
+  typedef typename V::type T;
+  T val2 = V::Fmadd(V::Set1(12102203.1615614f), val, V::Set1(1065353216.f));
+  T val4 = V::Max(V::Min(val2, V::Set1(2139095040.f)), V::Set1(0.f));
+  typename V::itype val4i = V::Cvtt(val4);
+  T xu = V::AsFloat(V::AndI(val4i, 0x7F800000));
+  T b = V::AsFloat(V::OrI(V::AndI(val4i, 0x7FFFFF), 0x3F800000));
+
+  T p = V::Fmadd(b, V::Set1(1.3671023382430374383648148e-2f), V::Set1(-2.88093587581985443087955e-3f));
+  p = V::Fmadd(b, p, V::Set1(0.168143436463395944830000f));
+  p = V::Fmadd(b, p, V::Set1(0.310670891004095530771135f));
+  p = V::Fmadd(b, p, V::Set1(0.510397365625862338668154f));
+  return V::Mul(xu, p);
+}
+
+template <class V>
+typename V::type LogApprox(typename V::type val) {
+  typedef typename V::type T;
+  typename V::itype vali = V::AsInt(val);
+  T exp = V::ToFloat(V::Sra23(vali));
+  T addcst = V::IfPositive(val, -89.970756366f, -__builtin_inff());
+  T x = V::AsFloat(V::OrI(V::AndI(vali, 0x7FFFFF), 0x3F800000));
+
+  T p = V::Fmadd(x, V::Set1(3.110401639e-2f), V::Set1(-0.288739945f));
+  p = V::Fmadd(x, p, V::Set1(1.130626167f));
+  p = V::Fmadd(x, p, V::Set1(-2.461222105f));
+  p = V::Fmadd(x, p, V::Set1(3.529304993f));
+  return V::Fmadd(x, p, V::Fmadd(V::Set1(0.69314718055995f), exp, addcst));
+}
+
+template <class V>
+typename V::type TanhApprox(typename V::type x) {
+  typedef typename V::type T;
+  x = V::Max(V::Min(x, V::Set1(4.97f)), V::Set1(-4.97f));
+  T x2 = V::Mul(x, x);
+  T a = V::Add(x2, V::Set1(378.0f));
+  a = V::Fmadd(x2, a, V::Set1(17325.0f));
+  a = V::Mul(x, V::Fmadd(x2, a, V::Set1(135135.0f)));
+  T b = V::Fmadd(x2, V::Set1(28.0f), V::Set1(3150.0f));
+  b = V::Fmadd(x2, b, V::Set1(62370.0f));
+  b = V::Fmadd(x2, b, V::Set1(135135.0f));
+  return V::Div(a, b);
+}
+
+template <class V>
+typename V::type Sigmoid(typename V::type x) {
+  const typename V::type one = V::Set1(1.0f);
+  return V::Div(one, V::Add(one, ExpApprox<V>(V::Sub(V::Set1(0.0f), x))));
+}
+
+// null operands are zero
+template <class V>
+typename V::type LoadOrZero(const float* p, unsigned i) {
+  return p ? V::Load(p + i) : V::Set1(0.0f);
+}
+
+// Loops over [begin, end) in steps of V::N, end - begin is a multiple of V::N
+
+template <class V>
+void ExpLoop(float* out, const float* in, unsigned begin, unsigned end) {
+  for (unsigned i = begin; i < end; i += V::N) {
+    V::Store(out + i, ExpApprox<V>(V::Load(in + i)));
+  }
+}
+
+template <class V>
+void LogLoop(float* out, const float* in, unsigned begin, unsigned end) {
+  for (unsigned i = begin; i < end; i += V::N) {
+    V::Store(out + i, LogApprox<V>(V::Load(in + i)));
+  }
+}
+
+template <class V>
+void TanhLoop(float* out, const float* in, unsigned begin, unsigned end) {
+  for (unsigned i = begin; i < end; i += V::N) {
+    V::Store(out + i, TanhApprox<V>(V::Load(in + i)));
+  }
+}
+
+template <class V>
+float SumExpLoop(const float* in, float shift, unsigned begin, unsigned end) {
+  typename V::type sum = V::Set1(0.0f);
+  const typename V::type s = V::Set1(shift);
+  for (unsigned i = begin; i < end; i += V::N) {
+    sum = V::Add(sum, ExpApprox<V>(V::Sub(V::Load(in + i), s)));
+  }
+  return V::Sum(sum);
+}
+
+template <class V>
+float ExpAndSumLoop(float* out, const float* in, float shift, unsigned begin, unsigned end) {
+  typename V::type sum = V::Set1(0.0f);
+  const typename V::type s = V::Set1(shift);
+  for (unsigned i = begin; i < end; i += V::N) {
+    typename V::type e = ExpApprox<V>(V::Sub(V::Load(in + i), s));
+    V::Store(out + i, e);
+    sum = V::Add(sum, e);
+  }
+  return V::Sum(sum);
+}
+
+template <class V>
+void TanhSumLoop(float* out, const float* a, const float* b, unsigned begin, unsigned end) {
+  for (unsigned i = begin; i < end; i += V::N) {
+    V::Store(out + i, TanhApprox<V>(V::Add(V::Load(a + i), V::Load(b + i))));
+  }
+}
+
+template <class V>
+float TanhSumDotLoop(const float* a, const float* b, const float* v, unsigned begin, unsigned end) {
+  typename V::type sum = V::Set1(0.0f);
+  for (unsigned i = begin; i < end; i += V::N) {
+    sum = V::Fmadd(V::Load(v + i), TanhApprox<V>(V::Add(V::Load(a + i), V::Load(b + i))), sum);
+  }
+  return V::Sum(sum);
+}
+
+template <class V>
+void GRUUpdateLoop(float* out, const float* state,
+                   const float* x, const float* y, const float* b,
+                   const float* h, const float* bh,
+                   const float* t, const float* bt,
+                   unsigned n, unsigned begin, unsigned end)
+{
+  typedef typename V::type T;
+  for (unsigned i = begin; i < end; i += V::N) {
+    const unsigned k = i + n;
+    T r = Sigmoid<V>(V::Add(V::Add(V::Load(x + i), LoadOrZero<V>(y, i)), LoadOrZero<V>(b, i)));
+    T u = Sigmoid<V>(V::Add(V::Add(V::Load(x + k), LoadOrZero<V>(y, k)), LoadOrZero<V>(b, k)));
+
+    T hv = V::Add(LoadOrZero<V>(h, i), LoadOrZero<V>(bh, i));
+    T t2v = V::Add(V::Load(t + i), LoadOrZero<V>(bt, i));
+    hv = TanhApprox<V>(V::Fmadd(r, t2v, hv));
+
+    // (1 - u) * hv + u * state
+    V::Store(out + i, V::Fmadd(u, V::Sub(V::Load(state + i), hv), hv));
+  }
+}
+
+// Sums of x - shift and (x - shift)^2 with x = in + bias. The shift, any
+// value of the row, keeps the variance from cancelling out.
+template <class V>
+void MomentsLoop(const float* in, const float* bias, float shift,
+                 unsigned begin, unsigned end, float& sum, float& sumSq)
+{
+  typedef typename V::type T;
+  T s = V::Set1(0.0f);
+  T sq = V::Set1(0.0f);
+  const T k = V::Set1(shift);
+  for (unsigned i = begin; i < end; i += V::N) {
+    T x = V::Sub(V::Add(V::Load(in + i), LoadOrZero<V>(bias, i)), k);
+    s = V::Add(s, x);
+    sq = V::Fmadd(x, x, sq);
+  }
+  sum += V::Sum(s);
+  sumSq += V::Sum(sq);
+}
+
+template <class V>
+void NormalizeLoop(float* row, const float* bias, const float* gamma, const float* beta,
+                   float mean, float invSigma, unsigned begin, unsigned end)
+{
+  typedef typename V::type T;
+  const T m = V::Set1(mean);
+  const T inv = V::Set1(invSigma);
+  for (unsigned i = begin; i < end; i += V::N) {
+    T x = V::Sub(V::Add(V::Load(row + i), LoadOrZero<V>(bias, i)), m);
+    V::Store(row + i, V::Fmadd(V::Mul(V::Load(gamma + i), x), inv, LoadOrZero<V>(beta, i)));
+  }
+}
+
+// Full vectors with V, the rest with Scalar
+
+template <class V>
+void Exp(float* out, const float* in, unsigned n) {
+  const unsigned m = n / V::N * V::N;
+  ExpLoop<V>(out, in, 0, m);
+  ExpLoop<Scalar>(out, in, m, n);
+}
+
+template <class V>
+void Log(float* out, const float* in, unsigned n) {
+  const unsigned m = n / V::N * V::N;
+  LogLoop<V>(out, in, 0, m);
+  LogLoop<Scalar>(out, in, m, n);
+}
+
+template <class V>
+void Tanh(float* out, const float* in, unsigned n) {
+  const unsigned m = n / V::N * V::N;
+  TanhLoop<V>(out, in, 0, m);
+  TanhLoop<Scalar>(out, in, m, n);
+}
+
+template <class V>
+float SumExp(const float* in, unsigned n, float shift) {
+  const unsigned m = n / V::N * V::N;
+  return SumExpLoop<V>(in, shift, 0, m) + SumExpLoop<Scalar>(in, shift, m, n);
+}
+
+template <class V>
+float ExpAndSum(float* out, const float* in, unsigned n, float shift) {
+  const unsigned m = n / V::N * V::N;
+  return ExpAndSumLoop<V>(out, in, shift, 0, m) + ExpAndSumLoop<Scalar>(out, in, shift, m, n);
+}
+
+template <class V>
+void TanhSum(float* out, const float* a, const float* b, unsigned n) {
+  const unsigned m = n / V::N * V::N;
+  TanhSumLoop<V>(out, a, b, 0, m);
+  TanhSumLoop<Scalar>(out, a, b, m, n);
+}
+
+template <class V>
+float TanhSumDot(const float* a, const float* b, const float* v, unsigned n) {
+  const unsigned m = n / V::N * V::N;
+  return TanhSumDotLoop<V>(a, b, v, 0, m) + TanhSumDotLoop<Scalar>(a, b, v, m, n);
+}
+
+template <class V>
+void GRUUpdate(float* out, const float* state,
+               const float* x, const float* y, const float* b,
+               const float* h, const float* bh,
+               const float* t, const float* bt, unsigned n)
+{
+  const unsigned m = n / V::N * V::N;
+  GRUUpdateLoop<V>(out, state, x, y, b, h, bh, t, bt, n, 0, m);
+  GRUUpdateLoop<Scalar>(out, state, x, y, b, h, bh, t, bt, n, m, n);
+}
+
+template <class V>
+void LayerNormalization(float* row, const float* bias,
+                        const float* gamma, const float* beta,
+                        unsigned n, float eps)
+{
+  const unsigned m = n / V::N * V::N;
+  const float shift = n ? row[0] + (bias ? bias[0] : 0.0f) : 0.0f;
+
+  float sum = 0.0f;
+  float sumSq = 0.0f;
+  MomentsLoop<V>(row, bias, shift, 0, m, sum, sumSq);
+  MomentsLoop<Scalar>(row, bias, shift, m, n, sum, sumSq);
+
+  const float mean = sum / n;
+  const float variance = sumSq / n - mean * mean;
+  const float invSigma = 1.0f / __builtin_sqrtf(variance + eps);
+
+  NormalizeLoop<V>(row, bias, gamma, beta, mean + shift, invSigma, 0, m);
+  NormalizeLoop<Scalar>(row, bias, gamma, beta, mean + shift, invSigma, m, n);
+}
+
+template <class V>
+Functions MakeFunctions(const char* name) {
+  Functions functions;
+  functions.name = name;
+  functions.exp = &Exp<V>;
+  functions.log = &Log<V>;
+  functions.tanh = &Tanh<V>;
+  functions.sumExp = &SumExp<V>;
+  functions.expAndSum = &ExpAndSum<V>;
+  functions.tanhSum = &TanhSum<V>;
+  functions.tanhSumDot = &TanhSumDot<V>;
+  functions.gruUpdate = &GRUUpdate<V>;
+  functions.layerNormalization = &LayerNormalization<V>;
+  return functions;
+}
+
+}
+
+}
+}
+}
+}
@@ -1,14 +1,18 @@
 #pragma once
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <limits>
 #include <vector>
 #include <sstream>
 
 #include <blaze/Math.h>
 #include "phoenix_functions.h"
+#include "simd_functions.h"
 #include "common/base_tensor.h"
 #include "common/exception.h"
+#include "common/types.h"
 
 namespace amunmt {
 namespace CPU {
@@ -104,8 +108,7 @@ class BlazeMatrix : public BaseTensor, public blaze::CustomMatrix<T, blaze::unal
       assert(beam == 1);
       assert(batches == 1);
       data_.resize(rows * columns);
-      BlazeBase temp(data_.data(), rows, columns);
-      std::swap(temp, *(BlazeBase*)this);
+      Rebind(rows, columns);
     }
 
     BlazeMatrix<T, SO>& operator=(const value_type& val) {
@@ -116,9 +119,7 @@ class BlazeMatrix : public BaseTensor, public blaze::CustomMatrix<T, blaze::unal
     template <class MT>
     BlazeMatrix<T, SO>& operator=(const MT& rhs) {
       Resize(rhs.rows(), rhs.columns());
-      BlazeBase temp(data_.data(), rhs.rows(), rhs.columns());
-      temp = rhs;
-      std::swap(temp, *(BlazeBase*)this);
+      *(BlazeBase*)this = rhs;
       return *this;
     }
 
@@ -152,6 +153,16 @@ class BlazeMatrix : public BaseTensor, public blaze::CustomMatrix<T, blaze::unal
     }
 
   private:
+    // Every new view allocates the reference count of its shared_array, so
+    // it is only replaced when the buffer or the shape has changed.
+    void Rebind(unsigned rows, unsigned columns) {
+      if (BlazeBase::data() != data_.data()
+          || BlazeBase::rows() != rows || BlazeBase::columns() != columns) {
+        BlazeBase temp(data_.data(), rows, columns);
+        std::swap(temp, *(BlazeBase*)this);
+      }
+    }
+
     std::vector<value_type> data_;
 };
 
@@ -173,6 +184,95 @@ class ArrayMatrix : public BlazeMatrix<float, blaze::rowMajor>
       : Parent(rhs)
     {}
 
+    // evaluates expressions into the existing buffer instead of a temporary
+    using Parent::operator=;
+};
+
+////////////////////////////////////////////////////////////////////////
+// Read-only model matrix. Rows are aligned and spaced by a multiple of the
+// SIMD width, with zeros in between, so that products use aligned loads.
+// Blaze is told the matrix is unpadded, since it would otherwise write the
+// zeros into every view it is given. The elements are either owned or part
+// of a mapped model file, which stays mapped as long as any of its matrices
+// is alive. Copies share the elements.
+class WeightTensor : public BaseTensor, public blaze::CustomMatrix<float, blaze::aligned,
+                                                                  blaze::unpadded,
+                                                                  blaze::rowMajor> {
+  public:
+    typedef blaze::CustomMatrix<float, blaze::aligned, blaze::unpadded, blaze::rowMajor> Parent;
+
+    // row spacing in floats, enough for every SIMD width Blaze may be built for
+    static const unsigned PADDING = 16;
+
+    static unsigned Spacing(unsigned columns) {
+      return (columns + PADDING - 1) / PADDING * PADDING;
+    }
+
+    WeightTensor() {}
+
+    // owned rows x columns zeros
+    WeightTensor(unsigned rows, unsigned columns) {
+      Allocate(rows, columns);
+    }
+
+    // owned copy of a matrix expression
+    template <class MT>
+    explicit WeightTensor(const MT& rhs) {
+      Allocate(rhs.rows(), rhs.columns());
+      *(Parent*)this = rhs;
+    }
+
+    // view of rows x columns elements at data, which is never written to.
+    // storage is kept alive until the last copy of the view is gone.
+    WeightTensor(const float* data, unsigned rows, unsigned columns, unsigned spacing,
+                 std::shared_ptr<const void> storage) {
+      if (rows * columns == 0) {
+        return;
+      }
+      Parent temp(const_cast<float*>(data), rows, columns, spacing,
+                  [storage](float*) {});
+      std::swap(temp, *(Parent*)this);
+    }
+
+    WeightTensor(const WeightTensor&) = default;
+    WeightTensor(WeightTensor&&) = default;
+    WeightTensor& operator=(WeightTensor&&) = default;
+
+    // shares the elements of rhs, Blaze would copy them into ours
+    WeightTensor& operator=(const WeightTensor& rhs) {
+      Parent temp(rhs);
+      std::swap(temp, *(Parent*)this);
+      return *this;
+    }
+
+    virtual unsigned dim(unsigned i) const
+    {
+      switch (i) {
+      case 0: return Parent::rows();
+      case 1: return Parent::columns();
+      case 2: return 1;
+      case 3: return 1;
+      default:
+        abort();
+      }
+    }
+
+    virtual void Resize(unsigned rows, unsigned cols, unsigned beam = 1, unsigned batches = 1)
+    {
+      amunmt_UTIL_THROW2("Not implemented");
+    }
+
+  private:
+    void Allocate(unsigned rows, unsigned columns) {
+      if (rows * columns == 0) {
+        return;
+      }
+      float* data = blaze::allocate<float>(rows * Spacing(columns));
+      std::fill(data, data + rows * Spacing(columns), 0.0f);
+      Parent temp(data, rows, columns, Spacing(columns),
+                  [](float* data) { blaze::deallocate(data); });
+      std::swap(temp, *(Parent*)this);
+    }
 };
 
 ////////////////////////////////////////////////////////////////////////
@@ -258,7 +358,8 @@ const bool byColumn = false;
 
 template <bool byRow, class MT, class MT1, class MT2>
 MT Concat(const MT1& m1, const MT2& m2) {
-  MT out = m1;
+  MT out;
+  out = m1;
   if(byRow) {
     assert(m1.columns() == m2.columns());
     unsigned rows1 = m1.rows();
@@ -282,6 +383,23 @@ MT Concat(const MT1& m1, const MT2& m2) {
   return std::move(out);
 }
 
+// Concat into existing storage, Out keeps its capacity between calls
+template <bool byRow, class MT, class MT1, class MT2>
+void Concat(MT& Out, const MT1& m1, const MT2& m2) {
+  if(byRow) {
+    assert(m1.columns() == m2.columns());
+    Out.resize(m1.rows() + m2.rows(), m1.columns(), false);
+    blaze::submatrix(Out, 0, 0, m1.rows(), m1.columns()) = m1;
+    blaze::submatrix(Out, m1.rows(), 0, m2.rows(), m2.columns()) = m2;
+  }
+  else {
+    assert(m1.rows() == m2.rows());
+    Out.resize(m1.rows(), m1.columns() + m2.columns(), false);
+    blaze::submatrix(Out, 0, 0, m1.rows(), m1.columns()) = m1;
+    blaze::submatrix(Out, 0, m1.columns(), m2.rows(), m2.columns()) = m2;
+  }
+}
+
 template <bool byRow, class MT, class MT1>
 MT Assemble(const MT1& in,
             const std::vector<unsigned>& indices) {
@@ -303,23 +421,84 @@ MT Assemble(const MT1& in,
   return std::move(out);
 }
 
+// Assemble into existing storage, e.g. the reordered beam states
+template <bool byRow, class MT, class MT1>
+void Assemble(MT& Out, const MT1& in, const std::vector<unsigned>& indices) {
+  if(byRow) {
+    Out.resize(indices.size(), in.columns(), false);
+    for(unsigned i = 0; i < indices.size(); ++i)
+      blaze::row(Out, i) = blaze::row(in, indices[i]);
+  }
+  else {
+    Out.resize(in.rows(), indices.size(), false);
+    for(unsigned i = 0; i < indices.size(); ++i)
+      blaze::column(Out, i) = blaze::column(in, indices[i]);
+  }
+}
+
+template <class MT, class MT1>
+MT Transpose(const MT1& in) {
+  MT out;
+  out = blaze::trans(in);
+  return out;
+}
+
+// Out = In * W, with the columns of W cut into shards. runShards(n, shard)
+// calls shard(i) for every i in [0, n), e.g. ThreadPool::parallel_for, which
+// computes them as subtasks. Meant for output layers, whose columns are the
+// vocabulary.
+template <class MT, class MT1, class MT2, class RunShards>
+void ShardedProd(MT& Out, const MT1& In, const MT2& W, unsigned shards, RunShards&& runShards) {
+  // shards start at multiples of the SIMD width
+  const unsigned ALIGN = 16;
+  unsigned columns = W.columns();
+  unsigned width = shards > 1 ? ((columns + shards - 1) / shards + ALIGN - 1) / ALIGN * ALIGN : columns;
+  if (width >= columns) {
+    Out = In * W;
+    return;
+  }
+
+  Out.Resize(In.rows(), columns);
+  runShards((columns + width - 1) / width, [&](size_t i) {
+    unsigned begin = i * width;
+    unsigned n = std::min(width, columns - begin);
+    blaze::submatrix(Out, 0, begin, Out.rows(), n) = In * blaze::submatrix(W, 0, begin, W.rows(), n);
+  });
+}
+
+// Out = columns indices of trans(inT), i.e. Assemble<byColumn> from the
+// transposed copy inT. Blocks of rows of inT are read side by side so that
+// both the reads and the writes to each row of Out stay contiguous.
+template <class MT, class MT1>
+void AssembleTransposed(MT& Out, const MT1& inT, const std::vector<unsigned>& indices) {
+  const unsigned BLOCK = 16;
+  const float* rows[BLOCK];
+  Out.resize(inT.columns(), indices.size(), false);
+  for(unsigned i = 0; i < indices.size(); i += BLOCK) {
+    unsigned n = std::min<unsigned>(BLOCK, indices.size() - i);
+    for(unsigned k = 0; k < n; ++k)
+      rows[k] = &inT(indices[i + k], 0);
+    for(unsigned j = 0; j < Out.rows(); ++j) {
+      float* out = &Out(j, i);
+      for(unsigned k = 0; k < n; ++k)
+        out[k] = rows[k][j];
+    }
+  }
+}
+
 template <class MT>
 void SafeSoftmax(MT& Out) {
   unsigned rows = Out.rows();
   unsigned cols = Out.columns();
-  float sum[rows];
   for (int j = 0; j < rows; ++j) {
+    float* row = &Out(j, 0);
     float maxRowValue = 0.0f;
     for (int i = 0; i < cols; ++i) {
-      maxRowValue = std::max(maxRowValue, Out(j,i));
-    }
-    sum[j] = 0;
-    for (int i = 0; i < cols; ++i) {
-      Out(j, i) = expapprox(Out(j, i) - maxRowValue);
-      sum[j] += Out(j, i);
+      maxRowValue = std::max(maxRowValue, row[i]);
     }
+    float sum = simd::ExpAndSum(row, row, cols, maxRowValue);
     for(int i = 0; i < cols; ++i) {
-      Out(j, i) /= sum[j];
+      row[i] /= sum;
     }
   }
 }
@@ -328,15 +507,84 @@ template <class MT>
 void LogSoftmax(MT& Out) {
   unsigned rows = Out.rows();
   unsigned cols = Out.columns();
-  float sum[rows];
   for (int j = 0; j < rows; ++j) {
-    sum[j] = 0;
-    for (int i = 0; i < cols; ++i) {
-      sum[j] += expapprox(Out(j, i));
-    }
+    float* row = &Out(j, 0);
+    float logSum = logapprox(simd::SumExp(row, cols, 0.0f));
     for(int i = 0; i < cols; ++i) {
-      Out(j, i) -= logapprox(sum[j]);
+      row[i] -= logSum;
+    }
+  }
+}
+
+// Fused log-softmax and n-best selection over unnormalised logits.
+// Rows are grouped by sentence: one row per sentence if isFirst, otherwise
+// beamSizes[i] rows. For every row the max and then the sum of exponentials
+// are taken in vectorized passes, the last pass turns each logit into
+// weight * logprob + cost and keeps the best beamSizes[i] entries of the
+// sentence in a min-heap. No rows * cols index array is allocated.
+// Keys are global (row * cols + col), results are best first per sentence.
+template <class MT>
+void LogSoftmaxAndNBest(std::vector<size_t>& outKeys,
+                        std::vector<float>& outCosts,
+                        std::vector<unsigned>& outBatchIds,
+                        const MT& In,
+                        const std::vector<float>& costs,
+                        float weight,
+                        bool forbidUNK,
+                        const std::vector<unsigned>& beamSizes,
+                        bool isFirst)
+{
+  typedef std::pair<float, size_t> Entry;
+  auto worse = [](const Entry& a, const Entry& b) { return a.first > b.first; };
+
+  const size_t cols = In.columns();
+  std::vector<Entry> heap;
+
+  outKeys.clear();
+  outCosts.clear();
+  outBatchIds.clear();
+
+  size_t rowStart = 0;
+  for (size_t batchId = 0; batchId < beamSizes.size(); ++batchId) {
+    size_t rows = isFirst ? 1 : beamSizes[batchId];
+    size_t beamSize = beamSizes[batchId];
+
+    heap.clear();
+    for (size_t j = rowStart; j < rowStart + rows; ++j) {
+      const float* rowIn = In.data() + j * In.spacing();
+
+      float maxVal = std::numeric_limits<float>::lowest();
+      for (size_t i = 0; i < cols; ++i) {
+        maxVal = std::max(maxVal, rowIn[i]);
+      }
+
+      const float logSum = maxVal + logapprox(simd::SumExp(rowIn, cols, maxVal));
+      const float cost = costs[j];
+      for (size_t i = 0; i < cols; ++i) {
+        if (forbidUNK && i == UNK_ID) {
+          continue;
+        }
+
+        float score = weight * (rowIn[i] - logSum) + cost;
+        if (heap.size() < beamSize) {
+          heap.emplace_back(score, j * cols + i);
+          std::push_heap(heap.begin(), heap.end(), worse);
+        } else if (score > heap.front().first) {
+          std::pop_heap(heap.begin(), heap.end(), worse);
+          heap.back() = Entry(score, j * cols + i);
+          std::push_heap(heap.begin(), heap.end(), worse);
+        }
+      }
     }
+
+    std::sort_heap(heap.begin(), heap.end(), worse);
+    for (const auto& entry : heap) {
+      outKeys.push_back(entry.second);
+      outCosts.push_back(entry.first);
+      outBatchIds.push_back(batchId);
+    }
+
+    rowStart += rows;
   }
 }
 
@@ -344,21 +592,17 @@ template <class MT>
 void Softmax(MT& Out) {
   unsigned rows = Out.rows();
   unsigned cols = Out.columns();
-  float sum[rows];
   for (int j = 0; j < rows; ++j) {
+    float* row = &Out(j, 0);
     float maxRowValue = 0.0f;
     for (int i = 0; i < cols; ++i) {
-      maxRowValue = std::max(maxRowValue, Out(j,i));
+      maxRowValue = std::max(maxRowValue, row[i]);
     }
 
-    sum[j] = 0;
-    for (int i = 0; i < cols; ++i) {
-      Out(j,i) = expapprox(Out(j, i) - maxRowValue);
-      sum[j] += Out(j, i);
-    }
+    float sum = simd::ExpAndSum(row, row, cols, maxRowValue);
 
     for(int i = 0; i < cols; ++i) {
-      Out(j, i) /= sum[j];
+      row[i] /= sum;
     }
   }
 }
@@ -383,80 +627,53 @@ MT Broadcast(const Functor& functor, const MT1& m1, const MT2& m2) {
   return std::move(out);
 }
 
-template<class MT>
-void LayerNormalization(MT& in, const MT& gamma, const MT& beta, float eps=1e-5f) {
-  eps=1e-5f;
-  // std::cerr << "LAYER NORM" << std::endl;
-  // std::cerr << std::endl;
-  unsigned rows = in.rows();
-  unsigned cols = in.columns();
-
-  for (int j = 0; j < rows; ++j) {
-    // std::cerr << "PRE ";
-    // for (int i = 0; i < 10; ++i) {
-      // std::cerr << in(j, i) << " ";
-    // }
-    // std::cerr << std::endl;
-    //
-    float sum = 0.0f;
-    for (int i = 0; i < cols; ++i) {
-      sum += in(j, i);
-    }
-
-    float mean = sum / cols;
-
-    float sigma = 0.0f;
-    for (int i = 0; i < cols; ++i) {
-      sigma += (in(j, i) - mean) * (in(j, i) - mean);
-    }
-    sigma /= cols;
-
-    sigma = sqrt(sigma + eps);
-
-    // std::cerr << "MIDD ";
-    // for (int i = 0; i < 10; ++i) {
-      // std::cerr << ( (in(j, i) - mean) / sigma) << " ";
-    // }
-    // std::cerr << std::endl;
-
-    for (int i = 0; i < cols; ++i) {
-      in(j, i) = gamma(i, 0) * ( (in(j, i) - mean) / sigma) + beta(i, 0);
+// Additive attention scores, computed in place without the
+// (keys * queries) x dim temporary of Broadcast<Tanh> and a product with v:
+//   Out(j, k) = sum_d v[d] * tanh(Keys(k, d) + Queries(j, d))
+template <class MT, class MT1, class MT2, class VT>
+void AttentionScores(MT& Out, const MT1& Keys, const MT2& Queries, const VT& v) {
+  const unsigned dim = Keys.columns();
+  for (unsigned j = 0; j < Queries.rows(); ++j) {
+    const float* query = &Queries(j, 0);
+    for (unsigned k = 0; k < Keys.rows(); ++k) {
+      Out(j, k) = simd::TanhSumDot(&Keys(k, 0), query, &v[0], dim);
     }
+  }
+}
 
-    // std::cerr << "POST ";
-    // for (int i = 0; i < 10; ++i) {
-      // std::cerr << in(j, i) << " ";
-    // }
-    // std::cerr << std::endl;
+// Out = tanh(Out + In)
+template <class MT, class MT1>
+void AddTanh(MT& Out, const MT1& In) {
+  for (unsigned j = 0; j < Out.rows(); ++j) {
+    simd::TanhSum(&Out(j, 0), &Out(j, 0), &In(j, 0), Out.columns());
   }
-  // std::cerr << "LAYER NORM: DONE" << std::endl;
 }
 
+// in = gamma * (in + bias - mean) / sigma + beta, row by row. bias, gamma and
+// beta are contiguous row vectors, loaded as 1 x n by NpzConverter::row();
+// null bias or beta skips it.
 template<class MT>
-void LayerNormalization(MT& in, const MT& gamma, float eps=1e-9) {
-  unsigned rows = in.rows();
-  unsigned cols = in.columns();
-
-  for (int j = 0; j < rows; ++j) {
-    float sum = 0.0f;
-    for (int i = 0; i < cols; ++i) {
-      sum += in(j, i);
-    }
-
-    float mean = sum / cols;
+void LayerNormalization(MT& in, const float* bias, const float* gamma, const float* beta, float eps) {
+  for (unsigned j = 0; j < in.rows(); ++j) {
+    simd::LayerNormalization(&in(j, 0), bias, gamma, beta, in.columns(), eps);
+  }
+}
 
-    float sigma = 0.0f;
-    for (int i = 0; i < cols; ++i) {
-      sigma += (in(j, i) - mean) * (in(j, i) - mean);
-    }
-    sigma /= cols;
+template<class MT, class GT>
+void LayerNormalization(MT& in, const GT& gamma, const GT& beta, float eps=1e-5f) {
+  eps=1e-5f;
+  LayerNormalization(in, nullptr, &gamma(0, 0), &beta(0, 0), eps);
+}
 
-    sigma = sqrt(sigma + eps);
+template<class MT, class GT>
+void LayerNormalization(MT& in, const GT& gamma, float eps=1e-9) {
+  LayerNormalization(in, nullptr, &gamma(0, 0), nullptr, eps);
+}
 
-    for (int i = 0; i < cols; ++i) {
-      in(j, i) = gamma(i, 0) * ( (in(j, i) - mean) / sigma);
-    }
-  }
+// AddBiasVector<byRow> followed by LayerNormalization in one pass over in
+template<class MT, class VT, class GT>
+void AddBiasAndLayerNormalization(MT& in, const VT& bias, const GT& gamma, const GT& beta) {
+  LayerNormalization(in, &bias(0, 0), &gamma(0, 0), &beta(0, 0), 1e-5f);
 }
 
 }
@@ -0,0 +1,39 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "common/logging.h"
+#include "cpu/dl4mt/model.h"
+#include "cpu/nematus/model.h"
+#include "cpu/npz_converter.h"
+
+using namespace amunmt;
+
+// Converts an .npz model for the CPU scorers into the format that amun maps
+// into memory (see cpu/npz_converter.h). Every matrix is stored the way the
+// Weights of the model type request it.
+int main(int argc, char* argv[]) {
+  if (argc != 4) {
+    std::cerr << "Usage: " << argv[0] << " type model.npz output" << std::endl
+              << "  type: the model type of the scorer, e.g. nematus2" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  auto info = spdlog::stderr_logger_mt("info");
+  info->set_pattern("[%c] (%L) %v");
+
+  std::string type = argv[1];
+  try {
+    CPU::NpzConverter model(argv[2]);
+    if (type == "nematus2") {
+      CPU::Nematus::Weights weights(model);
+    } else {
+      CPU::dl4mt::Weights weights(model);
+    }
+    model.Save(argv[3]);
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
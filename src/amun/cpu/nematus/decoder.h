@@ -5,6 +5,8 @@
 #include "gru.h"
 #include "transition.h"
 #include "common/god.h"
+#include "common/threadpool.h"
+#include "cpu/decoder/filtered_output_cache.h"
 
 namespace amunmt {
 namespace CPU {
@@ -20,14 +22,12 @@ class Decoder {
         {}
 
         void Lookup(mblas::Tensor& Rows, const std::vector<unsigned>& ids) {
-          using namespace mblas;
-          std::vector<unsigned> tids = ids;
-          for (auto&& id : tids) {
-            if (id >= w_.E_.rows()) {
-              id = 1;
-            }
+          // out of vocabulary ids are looked up as UNK_ID
+          Rows.resize(ids.size(), w_.E_.columns(), false);
+          for (unsigned i = 0; i < ids.size(); ++i) {
+            unsigned id = ids[i] < w_.E_.rows() ? ids[i] : UNK_ID;
+            blaze::row(Rows, i) = blaze::row(w_.E_, id);
           }
-          Rows = Assemble<byRow, Tensor>(w_.E_, tids);
         }
 
         size_t GetCols() {
@@ -54,23 +54,30 @@ class Decoder {
         void InitializeState(
           mblas::Tensor& State,
           const mblas::Tensor& SourceContext,
-          const size_t batchSize = 1)
+          const std::vector<unsigned>& sentenceLengths)
         {
           using namespace mblas;
 
-          // Calculate mean of source context, rowwise
-          // Repeat mean batchSize times by broadcasting
-          Temp1_ = Mean<byRow, Tensor>(SourceContext);
+          // Calculate mean of each sentence's source context, rowwise,
+          // skipping the padding
+          size_t batchSize = sentenceLengths.size();
+          size_t maxLength = SourceContext.rows() / batchSize;
 
           Temp2_.resize(batchSize, SourceContext.columns());
           Temp2_ = 0.0f;
-          AddBiasVector<byRow>(Temp2_, Temp1_);
+          for (size_t i = 0; i < batchSize; ++i) {
+            if (sentenceLengths[i]) {
+              Temp1_ = Mean<byRow, Tensor>(blaze::submatrix(SourceContext, i * maxLength, 0,
+                                                            sentenceLengths[i], SourceContext.columns()));
+              blaze::row(Temp2_, i) = blaze::row(Temp1_, 0);
+            }
+          }
 
           State = Temp2_ * w_.Wi_;
-          AddBiasVector<byRow>(State, w_.Bi_);
-
           if (w_.lns_.rows()) {
-            LayerNormalization(State, w_.lns_, w_.lnb_);
+            AddBiasAndLayerNormalization(State, w_.Bi_, w_.lns_, w_.lnb_);
+          } else {
+            AddBiasVector<byRow>(State, w_.Bi_);
           }
           State = blaze::forEach(State, Tanh());
           // std::cerr << "INIT: " << std::endl;
@@ -131,39 +138,61 @@ class Decoder {
         void Init(const mblas::Tensor& SourceContext) {
           using namespace mblas;
           SCU_ = SourceContext * w_.U_;
-          mblas::AddBiasVector<mblas::byRow>(SCU_, w_.B_);
-
           if (w_.Wc_att_lns_.rows()) {
-            LayerNormalization(SCU_, w_.Wc_att_lns_, w_.Wc_att_lnb_);
+            AddBiasAndLayerNormalization(SCU_, w_.B_, w_.Wc_att_lns_, w_.Wc_att_lnb_);
+          } else {
+            AddBiasVector<byRow>(SCU_, w_.B_);
           }
         }
 
         void GetAlignedSourceContext(
           mblas::Tensor& AlignedSourceContext,
           const mblas::Tensor& HiddenState,
-          const mblas::Tensor& SourceContext)
+          const mblas::Tensor& SourceContext,
+          const std::vector<unsigned>& sentenceLengths,
+          const std::vector<unsigned>& beamSizes)
         {
           using namespace mblas;
 
-          Temp2_ = HiddenState * w_.W_;
+          mblas::Prod(Temp2_, HiddenState, w_.W_, w_.Wp_);
           if (w_.W_comb_lns_.rows()) {
             LayerNormalization(Temp2_, w_.W_comb_lns_, w_.W_comb_lnb_);
           }
 
-          Temp1_ = Broadcast<Tensor>(Tanh(), SCU_, Temp2_);
+          // hypotheses are grouped by sentence, beamSizes[i] rows for sentence i.
+          // Attention weights of padded source positions stay 0.
+          // The c_tt bias is a constant shift which the softmax is invariant to.
+          size_t batchSize = sentenceLengths.size();
+          size_t maxLength = SourceContext.rows() / batchSize;
+          size_t cols = SourceContext.columns();
+
+          A_.resize(HiddenState.rows(), maxLength, false);
+          A_ = 0.0f;
+          AlignedSourceContext.resize(HiddenState.rows(), cols, false);
+          AlignedSourceContext = 0.0f;
+
+          size_t hypStart = 0;
+          for (size_t i = 0; i < batchSize; ++i) {
+            size_t beamSize = beamSizes[i];
+            size_t words = sentenceLengths[i];
+            if (beamSize == 0 || words == 0) {
+              hypStart += beamSize;
+              continue;
+            }
 
-          A_.resize(Temp1_.rows(), 1);
-          blaze::column(A_, 0) = Temp1_ * V_;
-          size_t words = SourceContext.rows();
-          // batch size, for batching, divide by numer of sentences
-          size_t batchSize = HiddenState.rows();
-          Reshape(A_, batchSize, words); // due to broadcasting above
+            auto A = blaze::submatrix(A_, hypStart, 0, beamSize, words);
+            AttentionScores(A,
+                            blaze::submatrix(SCU_, i * maxLength, 0, words, SCU_.columns()),
+                            blaze::submatrix(Temp2_, hypStart, 0, beamSize, Temp2_.columns()),
+                            V_);
 
-          float bias = w_.C_(0,0);
-          blaze::forEach(A_, [=](float x) { return x + bias; });
+            mblas::SafeSoftmax(A);
+            blaze::submatrix(AlignedSourceContext, hypStart, 0, beamSize, cols) =
+              A * blaze::submatrix(SourceContext, i * maxLength, 0, words, cols);
 
-          mblas::SafeSoftmax(A_);
-          AlignedSourceContext = A_ * SourceContext;
+            hypStart += beamSize;
+          }
+          assert(hypStart == HiddenState.rows());
         }
 
         void GetAttention(mblas::Tensor& Attention) {
@@ -178,7 +207,6 @@ class Decoder {
         const Weights& w_;
 
         mblas::Tensor SCU_;
-        mblas::Tensor Temp1_;
         mblas::Tensor Temp2_;
         mblas::Tensor A_;
         mblas::ColumnVector V_;
@@ -188,72 +216,111 @@ class Decoder {
     template <class Weights>
     class Softmax {
       public:
-        Softmax(const Weights& model)
+        // pool, shards: see ProdW4
+        Softmax(const Weights& model, ThreadPool* pool, unsigned shards)
         : w_(model),
-          filtered_(false)
+          pool_(pool),
+          shards_(shards)
         {}
 
         void GetProbs(mblas::ArrayMatrix& Probs,
                   const mblas::Tensor& State,
                   const mblas::Tensor& Embedding,
-                  const mblas::Tensor& AlignedSourceContext) {
+                  const mblas::Tensor& AlignedSourceContext,
+                  bool useFusedSoftmax) {
           using namespace mblas;
 
-          T1_ = State * w_.W1_;
-          AddBiasVector<byRow>(T1_, w_.B1_);
+          mblas::Prod(T1_, State, w_.W1_, w_.W1p_);
           if (w_.lns_1_.rows()) {
-            LayerNormalization(T1_, w_.lns_1_, w_.lnb_1_);
+            AddBiasAndLayerNormalization(T1_, w_.B1_, w_.lns_1_, w_.lnb_1_);
+          } else {
+            AddBiasVector<byRow>(T1_, w_.B1_);
           }
           // std::cerr << "State" << std::endl;
           // for(int i = 0; i < 5; ++i) std::cerr << T1_(0, i) << " ";
           // std::cerr << std::endl;
 
-          T2_ = Embedding * w_.W2_;
-          AddBiasVector<byRow>(T2_, w_.B2_);
+          mblas::Prod(T2_, Embedding, w_.W2_, w_.W2p_);
           if (w_.lns_2_.rows()) {
-            LayerNormalization(T2_, w_.lns_2_, w_.lnb_2_);
+            AddBiasAndLayerNormalization(T2_, w_.B2_, w_.lns_2_, w_.lnb_2_);
+          } else {
+            AddBiasVector<byRow>(T2_, w_.B2_);
           }
           // std::cerr << "emb" << std::endl;
           // for(int i = 0; i < 5; ++i) std::cerr << T2_(0, i) << " ";
           // std::cerr << std::endl;
 
-          T3_ = AlignedSourceContext * w_.W3_;
-          AddBiasVector<byRow>(T3_, w_.B3_);
+          mblas::Prod(T3_, AlignedSourceContext, w_.W3_, w_.W3p_);
           if (w_.lns_3_.rows()) {
-            LayerNormalization(T3_, w_.lns_3_, w_.lnb_3_);
+            AddBiasAndLayerNormalization(T3_, w_.B3_, w_.lns_3_, w_.lnb_3_);
+          } else {
+            AddBiasVector<byRow>(T3_, w_.B3_);
           }
           // std::cerr << "CTX" << std::endl;
           // for(int i = 0; i < 5; ++i) std::cerr << T3_(0, i) << " ";
           // std::cerr << std::endl;
 
-          auto t = blaze::forEach(T1_ + T2_ + T3_, Tanh());
+          T1_ += T2_;
+          AddTanh(T1_, T3_);
 
-          if(!filtered_) {
-            Probs = t * w_.W4_;
+          if (!w_.W4p_.empty()) {
+            if (filtered_) {
+              mblas::Prod(Probs, T1_, filtered_->W4p);
+              AddBiasVector<byRow>(Probs, filtered_->B4);
+            } else {
+              mblas::Prod(Probs, T1_, w_.W4p_);
+              AddBiasVector<byRow>(Probs, w_.B4_);
+            }
+          } else if(!filtered_) {
+            ProdW4(Probs, w_.W4_);
             AddBiasVector<byRow>(Probs, w_.B4_);
           } else {
-            Probs = t * FilteredW4_;
-            AddBiasVector<byRow>(Probs, FilteredB4_);
+            ProdW4(Probs, filtered_->W4);
+            AddBiasVector<byRow>(Probs, filtered_->B4);
           }
           // std::cerr << "LOgit" << std::endl;
           // for(int i = 0; i < 5; ++i) std::cerr << Probs(0, i) << " ";
           // std::cerr << std::endl;
-          LogSoftmax(Probs);
+          if (!useFusedSoftmax) {
+            LogSoftmax(Probs);
+          }
         }
 
-        void Filter(const std::vector<unsigned>& ids) {
-          filtered_ = true;
-          using namespace mblas;
-          FilteredW4_ = Assemble<byColumn, Tensor>(w_.W4_, ids);
-          FilteredB4_ = Assemble<byColumn, Tensor>(w_.B4_, ids);
+        void Filter(const std::vector<unsigned>& ids, FilteredOutputCache* cache) {
+          auto assemble = [&] {
+            using namespace mblas;
+            FilteredOutput output;
+            output.B4 = Assemble<byColumn, Tensor>(w_.B4_, ids);
+            if (!w_.W4p_.empty()) {
+              output.W4p = PackedTensor(w_.W4p_, ids, w_.W4T_);
+            } else if (w_.W4T_.rows() > 0) {
+              AssembleTransposed(output.W4, w_.W4T_, ids);
+            } else {
+              output.W4 = Assemble<byColumn, Tensor>(w_.W4_, ids);
+            }
+            return output;
+          };
+          if (cache) {
+            filtered_ = cache->Get(ids, assemble);
+          } else {
+            filtered_ = std::make_shared<const FilteredOutput>(assemble());
+          }
         }
 
       private:
+        // Probs = T1_ * W4, in shards_ subtasks on pool_ if there is one
+        template <class MT>
+        void ProdW4(mblas::ArrayMatrix& Probs, const MT& W4) {
+          mblas::ShardedProd(Probs, T1_, W4, pool_ ? shards_ : 1,
+                             [this](size_t n, auto&& shard) { pool_->parallel_for(n, shard); });
+        }
+
         const Weights& w_;
-        bool filtered_;
+        ThreadPool* pool_;
+        unsigned shards_;
 
-        mblas::Tensor FilteredW4_;
-        mblas::Tensor FilteredB4_;
+        // null without --softmax-filter
+        FilteredOutputPtr filtered_;
 
         mblas::Tensor T1_;
         mblas::Tensor T2_;
@@ -261,26 +328,31 @@ class Decoder {
     };
 
   public:
-    Decoder(const Weights& model)
+    // pool, vocabShards: see Softmax::ProdW4, --cpu-vocab-shards
+    Decoder(const Weights& model, ThreadPool* pool = nullptr, unsigned vocabShards = 1)
     : embeddings_(model.decEmbeddings_),
       rnn1_(model.decInit_, model.decGru1_),
       rnn2_(model.decGru2_, model.decTransition_),
       attention_(model.decAttention_),
-      softmax_(model.decSoftmax_)
+      softmax_(model.decSoftmax_, pool, vocabShards)
     {}
 
     void Decode(
       mblas::Tensor& NextState,
       const mblas::Tensor& State,
       const mblas::Tensor& Embeddings,
-      const mblas::Tensor& SourceContext)
+      const mblas::Tensor& SourceContext,
+      const std::vector<unsigned>& sentenceLengths,
+      const std::vector<unsigned>& beamSizes,
+      bool useFusedSoftmax)
     {
       GetHiddenState(HiddenState_, State, Embeddings);
       // std::cerr << "HIDDEN: " << std::endl;
       // for (int i = 0; i < 5; ++i) std::cerr << HiddenState_(0, i) << " ";
       // std::cerr << std::endl;
 
-      GetAlignedSourceContext(AlignedSourceContext_, HiddenState_, SourceContext);
+      GetAlignedSourceContext(AlignedSourceContext_, HiddenState_, SourceContext,
+                              sentenceLengths, beamSizes);
       // std::cerr << "ALIGNED SRC: " << std::endl;
       // for (int i = 0; i < 5; ++i) std::cerr << AlignedSourceContext_(0, i) << " ";
       // std::cerr << std::endl;
@@ -290,7 +362,7 @@ class Decoder {
       // for (int i = 0; i < 5; ++i) std::cerr << NextState(0, i) << " ";
       // std::cerr << std::endl;
 
-      GetProbs(NextState, Embeddings, AlignedSourceContext_);
+      GetProbs(NextState, Embeddings, AlignedSourceContext_, useFusedSoftmax);
     }
 
     mblas::ArrayMatrix& GetProbs() {
@@ -299,8 +371,8 @@ class Decoder {
 
     void EmptyState(mblas::Tensor& State,
                     const mblas::Tensor& SourceContext,
-                    size_t batchSize = 1) {
-    	rnn1_.InitializeState(State, SourceContext, batchSize);
+                    const std::vector<unsigned>& sentenceLengths) {
+    	rnn1_.InitializeState(State, SourceContext, sentenceLengths);
     	attention_.Init(SourceContext);
     }
 
@@ -315,8 +387,8 @@ class Decoder {
       embeddings_.Lookup(Embedding, w);
     }
 
-    void Filter(const std::vector<unsigned>& ids) {
-      softmax_.Filter(ids);
+    void Filter(const std::vector<unsigned>& ids, FilteredOutputCache* cache) {
+      softmax_.Filter(ids, cache);
     }
 
     void GetAttention(mblas::Tensor& attention) {
@@ -341,8 +413,11 @@ class Decoder {
 
     void GetAlignedSourceContext(mblas::Tensor& AlignedSourceContext,
                                  const mblas::Tensor& HiddenState,
-                                 const mblas::Tensor& SourceContext) {
-    	attention_.GetAlignedSourceContext(AlignedSourceContext, HiddenState, SourceContext);
+                                 const mblas::Tensor& SourceContext,
+                                 const std::vector<unsigned>& sentenceLengths,
+                                 const std::vector<unsigned>& beamSizes) {
+    	attention_.GetAlignedSourceContext(AlignedSourceContext, HiddenState, SourceContext,
+    	                                   sentenceLengths, beamSizes);
     }
 
     void GetNextState(mblas::Tensor& State,
@@ -354,8 +429,9 @@ class Decoder {
 
     void GetProbs(const mblas::Tensor& State,
                   const mblas::Tensor& Embedding,
-                  const mblas::Tensor& AlignedSourceContext) {
-      softmax_.GetProbs(Probs_, State, Embedding, AlignedSourceContext);
+                  const mblas::Tensor& AlignedSourceContext,
+                  bool useFusedSoftmax) {
+      softmax_.GetProbs(Probs_, State, Embedding, AlignedSourceContext, useFusedSoftmax);
     }
 
   private:
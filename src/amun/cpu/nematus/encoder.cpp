@@ -6,24 +6,38 @@ namespace amunmt {
 namespace CPU {
 namespace Nematus {
 
-void Encoder::GetContext(const std::vector<unsigned>& words, mblas::Tensor& context) {
-  std::vector<mblas::Tensor> embeddedWords;
+void Encoder::GetContext(const Sentences& sources, unsigned tab,
+                         mblas::Tensor& context, std::vector<unsigned>& sentenceLengths) {
+  size_t maxLength = 0;
+  sentenceLengths.resize(sources.size());
+  for (size_t i = 0; i < sources.size(); ++i) {
+    sentenceLengths[i] = sources.Get(i).GetWords(tab).size();
+    maxLength = std::max(maxLength, (size_t)sentenceLengths[i]);
+  }
 
-  context.resize(words.size(),
+  context.resize(sources.size() * maxLength,
                  forwardRnn_.GetStateLength() + backwardRnn_.GetStateLength());
+  context = 0.0f;
 
-  for (auto& w : words) {
-    embeddedWords.emplace_back();
-    mblas::Tensor &embed = embeddedWords.back();
-    embeddings_.Lookup(embed, w);
+  if (sources.size() == 0) {
+    return;
   }
 
-  forwardRnn_.GetContext(embeddedWords.cbegin(),
-						 embeddedWords.cend(),
-						 context, false);
-  backwardRnn_.GetContext(embeddedWords.crbegin(),
-						  embeddedWords.crend(),
-						  context, true);
+  embeddings_.Lookup(embeddedWords_, sources, tab, maxLength);
+
+  if (pool_) {
+    // the directions only share the embeddings and write disjoint column
+    // halves of context
+    ThreadPool::TaskGroup backward(*pool_);
+    backward.spawn([&] {
+      backwardRnn_.GetContext(embeddedWords_, context, sentenceLengths, true);
+    });
+    forwardRnn_.GetContext(embeddedWords_, context, sentenceLengths, false);
+    backward.wait();
+  } else {
+    forwardRnn_.GetContext(embeddedWords_, context, sentenceLengths, false);
+    backwardRnn_.GetContext(embeddedWords_, context, sentenceLengths, true);
+  }
 }
 
 }  // namespace Nematus
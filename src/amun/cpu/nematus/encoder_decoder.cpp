@@ -21,54 +21,57 @@ EncoderDecoder::EncoderDecoder(const God &god,
 							   const std::string& name,
                                const YAML::Node& config,
                                unsigned tab,
-                               const Nematus::Weights& model)
-  : CPUEncoderDecoderBase(god, name, config, tab),
+                               const Nematus::Weights& model,
+                               FilteredOutputCache* filterCache)
+  : CPUEncoderDecoderBase(god, name, config, tab, filterCache),
     model_(model),
-    encoder_(new CPU::Nematus::Encoder(model_)),
-    decoder_(new CPU::Nematus::Decoder(model_))
+    encoder_(new CPU::Nematus::Encoder(model_, god.Get<bool>("cpu-parallel-encoder")
+                                          ? &god.GetThreadPool() : nullptr)),
+    decoder_(new CPU::Nematus::Decoder(model_, &god.GetThreadPool(), god.Get<unsigned>("cpu-vocab-shards")))
 {}
 
 
-void EncoderDecoder::Decode(const State& in, State& out, const std::vector<unsigned>&)
+void EncoderDecoder::Decode(const State& in, State& out, const std::vector<unsigned>& beamSizes)
 {
   BEGIN_TIMER_CPU("Decode");
   const EDState& edIn = in.get<EDState>();
   EDState& edOut = out.get<EDState>();
 
   decoder_->Decode(edOut.GetStates(), edIn.GetStates(),
-                   edIn.GetEmbeddings(), SourceContext_);
+                   edIn.GetEmbeddings(), SourceContext_,
+                   sentenceLengths_, beamSizes, god_.UseFusedSoftmax());
   PAUSE_TIMER_CPU("Decode");
 }
 
 
 void EncoderDecoder::BeginSentenceState(State& state, unsigned batchSize) {
   EDState& edState = state.get<EDState>();
-  decoder_->EmptyState(edState.GetStates(), SourceContext_, batchSize);
+  assert(batchSize == sentenceLengths_.size());
+  decoder_->EmptyState(edState.GetStates(), SourceContext_, sentenceLengths_);
   decoder_->EmptyEmbedding(edState.GetEmbeddings(), batchSize);
 }
 
 
 void EncoderDecoder::Encode(const Sentences& sources) {
-  encoder_->GetContext(sources.Get(0).GetWords(tab_),
-                        SourceContext_);
+  encoder_->GetContext(sources, tab_, SourceContext_, sentenceLengths_);
 }
 
 
 void EncoderDecoder::AssembleBeamState(const State& in,
                                        const Beam& beam,
                                        State& out) {
-  std::vector<unsigned> beamWords;
-  std::vector<unsigned> beamStateIds;
-  for(auto h : beam) {
-      beamWords.push_back(h->GetWord());
-      beamStateIds.push_back(h->GetPrevStateIndex());
+  beamWords_.clear();
+  beamStateIds_.clear();
+  for (const HypothesisPtr& h : beam) {
+    beamWords_.push_back(h->GetWord());
+    beamStateIds_.push_back(h->GetPrevStateIndex());
   }
 
   const EDState& edIn = in.get<EDState>();
   EDState& edOut = out.get<EDState>();
 
-  edOut.GetStates() = mblas::Assemble<mblas::byRow, mblas::Tensor>(edIn.GetStates(), beamStateIds);
-  decoder_->Lookup(edOut.GetEmbeddings(), beamWords);
+  mblas::Assemble<mblas::byRow>(edOut.GetStates(), edIn.GetStates(), beamStateIds_);
+  decoder_->Lookup(edOut.GetEmbeddings(), beamWords_);
 }
 
 
@@ -88,7 +91,7 @@ unsigned EncoderDecoder::GetVocabSize() const {
 
 
 void EncoderDecoder::Filter(const std::vector<unsigned>& filterIds) {
-  decoder_->Filter(filterIds);
+  decoder_->Filter(filterIds, filterCache_);
 }
 
 
@@ -26,7 +26,8 @@ class EncoderDecoder : public CPUEncoderDecoderBase {
     			   const std::string& name,
                    const YAML::Node& config,
                    unsigned tab,
-                   const Nematus::Weights& model);
+                   const Nematus::Weights& model,
+                   FilteredOutputCache* filterCache = nullptr);
 
     virtual void Decode(const State& in, State& out, const std::vector<unsigned>& beamSizes);
 
@@ -51,6 +52,10 @@ class EncoderDecoder : public CPUEncoderDecoderBase {
     const Nematus::Weights& model_;
     std::unique_ptr<Nematus::Encoder> encoder_;
     std::unique_ptr<Nematus::Decoder> decoder_;
+
+    // reused by AssembleBeamState
+    std::vector<unsigned> beamWords_;
+    std::vector<unsigned> beamStateIds_;
 };
 
 
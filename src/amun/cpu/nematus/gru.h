@@ -1,5 +1,6 @@
 #pragma once
 #include "cpu/mblas/tensor.h"
+#include "cpu/mblas/packed.h"
 #include <iomanip>
 
 namespace amunmt {
@@ -11,114 +12,95 @@ class GRU {
     GRU(const Weights& model)
       : w_(model),
         layerNormalization_(w_.W_lns_.rows())
-    {
-      if (!layerNormalization_) {
-        WWx_ = mblas::Concat<mblas::byColumn, mblas::Tensor>(w_.W_, w_.Wx_);
-        UUx_ = mblas::Concat<mblas::byColumn, mblas::Tensor>(w_.U_, w_.Ux_);
-      }
-    }
+    {}
 
     void GetNextState(
       mblas::Tensor& nextState,
       const mblas::Tensor& state,
       const mblas::Tensor& context) const
     {
-      // std::cerr << "Get next state" << std::endl;
+      ProjectInput(RUH_, context);
+      GetNextStateFromInput(nextState, state, RUH_);
+    }
+
+    // The input side of GetNextState, context * [W Wx] (with biases and layer
+    // normalization for normalized models). It does not depend on the state,
+    // so the encoder computes it for all words of the batch in one product.
+    void ProjectInput(mblas::Tensor& RUH, const mblas::Tensor& context) const {
       if (layerNormalization_) {
-        RUH_1_ = context * w_.W_;
-        mblas::AddBiasVector<mblas::byRow>(RUH_1_, w_.B_);
-        LayerNormalization(RUH_1_, w_.W_lns_, w_.W_lnb_);
+        mblas::Prod(RUH_1_, context, w_.W_, w_.Wp_);
+        mblas::AddBiasAndLayerNormalization(RUH_1_, w_.B_, w_.W_lns_, w_.W_lnb_);
 
-        RUH_2_ = context * w_.Wx_;
-        mblas::AddBiasVector<mblas::byRow>(RUH_2_, w_.Bx1_);
-        LayerNormalization(RUH_2_, w_.Wx_lns_, w_.Wx_lnb_);
+        mblas::Prod(RUH_2_, context, w_.Wx_, w_.Wxp_);
+        mblas::AddBiasAndLayerNormalization(RUH_2_, w_.Bx1_, w_.Wx_lns_, w_.Wx_lnb_);
 
-        RUH_ = mblas::Concat<mblas::byColumn, mblas::Tensor>(RUH_1_, RUH_2_);
+        mblas::Concat<mblas::byColumn>(RUH, RUH_1_, RUH_2_);
+      } else {
+        mblas::Prod(RUH, context, w_.WWx_, w_.WWxp_);
+      }
+    }
 
-        Temp_1_ = state * w_.U_;
-        mblas::AddBiasVector<mblas::byRow>(Temp_1_, w_.Bx3_);
-        LayerNormalization(Temp_1_, w_.U_lns_, w_.U_lnb_);
+    // The recurrent side, RUH are the ProjectInput rows of the state rows
+    template <class MT>
+    void GetNextStateFromInput(
+      mblas::Tensor& nextState,
+      const mblas::Tensor& state,
+      const MT& RUH) const
+    {
+      if (layerNormalization_) {
+        mblas::Prod(Temp_1_, state, w_.U_, w_.Up_);
+        mblas::AddBiasAndLayerNormalization(Temp_1_, w_.Bx3_, w_.U_lns_, w_.U_lnb_);
 
-        Temp_2_ = state * w_.Ux_;
-        mblas::AddBiasVector<mblas::byRow>(Temp_2_, w_.Bx2_);
-        LayerNormalization(Temp_2_, w_.Ux_lns_, w_.Ux_lnb_);
+        mblas::Prod(Temp_2_, state, w_.Ux_, w_.Uxp_);
+        mblas::AddBiasAndLayerNormalization(Temp_2_, w_.Bx2_, w_.Ux_lns_, w_.Ux_lnb_);
 
-        Temp_ = mblas::Concat<mblas::byColumn, mblas::Tensor>(Temp_1_, Temp_2_);
+        mblas::Concat<mblas::byColumn>(Temp_, Temp_1_, Temp_2_);
 
-        ElementwiseOpsLayerNorm(nextState, state);
+        ElementwiseOpsLayerNorm(nextState, state, RUH);
 
       } else {
-        RUH_ = context * WWx_;
-        Temp_ = state * UUx_;
-        ElementwiseOps(nextState, state);
+        mblas::Prod(Temp_, state, w_.UUx_, w_.UUxp_);
+        ElementwiseOps(nextState, state, RUH);
       }
     }
 
-    void ElementwiseOps(mblas::Tensor& NextState, const mblas::Tensor& State) const {
+    template <class MT>
+    void ElementwiseOps(mblas::Tensor& NextState, const mblas::Tensor& State, const MT& RUH) const {
       using namespace mblas;
       using namespace blaze;
 
       const int rowNo = State.rows();
       const int colNo = State.columns();
-      NextState.resize(rowNo, colNo);
+      NextState.resize(rowNo, colNo, false);
 
       for (int j = 0; j < rowNo; ++j) {
-        auto rowOut = row(NextState, j);
-        auto rowState = row(State, j);
-
-        auto rowRuh = row(RUH_, j);
-        auto rowT   = row(Temp_, j);
-
-        auto rowH   = subvector(rowRuh, 2 * colNo, colNo);
-        auto rowT2  = subvector(rowT, 2 * colNo, colNo);
-
-        for (int i = 0; i < colNo; ++i) {
-          float ev1 = expapprox(-(rowRuh[i] + w_.B_(0, i) + rowT[i]));
-          float r = 1.0f / (1.0f + ev1);
+        const float* rowRuh = &RUH(j, 0);
+        const float* rowT   = &Temp_(j, 0);
 
-          int k = i + colNo;
-          float ev2 = expapprox(-(rowRuh[k] + w_.B_(0, k) + rowT[k]));
-          float u = 1.0f / (1.0f + ev2);
-
-          float hv = rowH[i] + w_.Bx1_(0, i);
-          float t2v = rowT2[i];
-          hv = tanhapprox(hv + r * t2v);
-          rowOut[i] = (1.0f - u) * hv + u * rowState[i];
-        }
+        simd::GRUUpdate(&NextState(j, 0), &State(j, 0),
+                        rowRuh, rowT, &w_.B_(0, 0),
+                        rowRuh + 2 * colNo, &w_.Bx1_(0, 0),
+                        rowT + 2 * colNo, nullptr, colNo);
       }
     }
 
-    void ElementwiseOpsLayerNorm(mblas::Tensor& NextState, const mblas::Tensor& State) const {
+    template <class MT>
+    void ElementwiseOpsLayerNorm(mblas::Tensor& NextState, const mblas::Tensor& State, const MT& RUH) const {
       using namespace mblas;
       using namespace blaze;
 
       const int rowNo = State.rows();
       const int colNo = State.columns();
-      NextState.resize(rowNo, colNo);
+      NextState.resize(rowNo, colNo, false);
 
       for (int j = 0; j < rowNo; ++j) {
-        auto rowOut = row(NextState, j);
-        auto rowState = row(State, j);
-
-        auto rowRuh = row(RUH_, j);
-        auto rowT   = row(Temp_, j);
-
-        auto rowH   = subvector(rowRuh, 2 * colNo, colNo);
-        auto rowT2  = subvector(rowT, 2 * colNo, colNo);
-
-        for (int i = 0; i < colNo; ++i) {
-          float ev1 = expapprox(-(rowRuh[i] + rowT[i]));
-          float r = 1.0f / (1.0f + ev1);
-
-          int k = i + colNo;
-          float ev2 = expapprox(-(rowRuh[k] + rowT[k]));
-          float u = 1.0f / (1.0f + ev2);
+        const float* rowRuh = &RUH(j, 0);
+        const float* rowT   = &Temp_(j, 0);
 
-          float hv = rowH[i];
-          float t2v = rowT2[i] + w_.Bx2_(0, i);
-          hv = tanhapprox(hv + r * t2v);
-          rowOut[i] = (1.0f - u) * hv + u * rowState[i];
-        }
+        simd::GRUUpdate(&NextState(j, 0), &State(j, 0),
+                        rowRuh, rowT, nullptr,
+                        rowRuh + 2 * colNo, nullptr,
+                        rowT + 2 * colNo, &w_.Bx2_(0, 0), colNo);
       }
     }
     size_t GetStateLength() const {
@@ -129,13 +111,6 @@ class GRU {
   private:
     // Model matrices
     const Weights& w_;
-    mutable mblas::Tensor WWx_;
-    mutable mblas::Tensor UUx_;
-    mutable mblas::Tensor Wbbx_;
-    mutable mblas::Tensor lns_WWx_;
-    mutable mblas::Tensor lns_UUx_;
-    mutable mblas::Tensor lnb_WWx_;
-    mutable mblas::Tensor lnb_UUx_;
 
     // reused to avoid allocation
     mutable mblas::Tensor RUH_;
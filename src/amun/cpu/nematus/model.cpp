@@ -4,29 +4,55 @@ namespace amunmt {
 namespace CPU {
 namespace Nematus {
 
+namespace {
+
+// [m1 m2] for the GRUs, which multiply by m1 and m2 apart if lns is not empty
+mblas::WeightTensor ConcatUnlessNormalized(const NpzConverter& model, const std::string& name,
+                                           const mblas::WeightTensor& lns,
+                                           const mblas::WeightTensor& m1,
+                                           const mblas::WeightTensor& m2) {
+  if (lns.rows()) {
+    return mblas::WeightTensor();
+  }
+  return model.derived(name, [&]() {
+    return mblas::WeightTensor(mblas::Concat<mblas::byColumn, mblas::Tensor>(m1, m2));
+  });
+}
+
+mblas::PackedTensor ConcatUnlessNormalized(const mblas::WeightTensor& lns,
+                                           const mblas::PackedTensor& m1,
+                                           const mblas::PackedTensor& m2) {
+  if (lns.rows() || m1.empty()) {
+    return mblas::PackedTensor();
+  }
+  return mblas::Concat(m1, m2);
+}
+
+}
+
 Weights::Transition::Transition(const NpzConverter& model, TransitionType type, std::string prefix,
-                                std::string infix)
+                                std::string infix, mblas::WeightLayout layout)
   : depth_(findTransitionDepth(model, prefix, infix)), type_(type)
 {
   for (int i = 1; i <= depth_; ++i) {
     U_.emplace_back(model[name(prefix, "U", infix, i)]);
     Ux_.emplace_back(model[name(prefix, "Ux", infix, i)]);
     B_.emplace_back(model(name(prefix, "b", infix, i), true));
-    U_lns_.emplace_back(model[name(prefix, "U", infix, i, "_lns")]);
-    U_lnb_.emplace_back(model[name(prefix, "U", infix, i, "_lnb")]);
-    Ux_lns_.emplace_back(model[name(prefix, "Ux", infix, i, "_lns")]);
-    Ux_lnb_.emplace_back(model[name(prefix, "Ux", infix, i, "_lnb")]);
+    U_lns_.emplace_back(model.row(name(prefix, "U", infix, i, "_lns")));
+    U_lnb_.emplace_back(model.row(name(prefix, "U", infix, i, "_lnb")));
+    Ux_lns_.emplace_back(model.row(name(prefix, "Ux", infix, i, "_lns")));
+    Ux_lnb_.emplace_back(model.row(name(prefix, "Ux", infix, i, "_lnb")));
+    Up_.emplace_back(U_.back(), layout);
+    Uxp_.emplace_back(Ux_.back(), layout);
 
     switch(type) {
       case TransitionType::Encoder:
         Bx1_.emplace_back(1, Ux_.back().dim(1));
-        const_cast<mblas::Tensor&>(Bx1_.back()) = 0.0f;
         Bx2_.emplace_back(model(name(prefix, "bx", infix, i), true));
         break;
       case TransitionType::Decoder:
         Bx1_.emplace_back(model(name(prefix, "bx", infix, i), true));
         Bx2_.emplace_back(1, Ux_.back().dim(1));
-        const_cast<mblas::Tensor&>(Bx2_.back()) = 0.0f;
         break;
     }
   }
@@ -68,7 +94,8 @@ Weights::Embeddings::Embeddings(const NpzConverter& model, const std::vector<std
   : E_(model.getFirstOfMany(keys))
 {}
 
-Weights::GRU::GRU(const NpzConverter& model, std::string prefix, std::vector<std::string> keys)
+Weights::GRU::GRU(const NpzConverter& model, std::string prefix, std::vector<std::string> keys,
+                  mblas::WeightLayout layout)
   : W_(model[prefix + keys.at(0)]),
     B_(model(prefix + keys.at(1), true)),
     U_(model[prefix + keys.at(2)]),
@@ -77,30 +104,36 @@ Weights::GRU::GRU(const NpzConverter& model, std::string prefix, std::vector<std
     Bx2_(Bx1_.rows(), Bx1_.columns()),
     Bx3_(B_.rows(), B_.columns()),
     Ux_(model[prefix + keys.at(5)]),
-    W_lns_(model[prefix + keys.at(6)]),
-    W_lnb_(model[prefix + keys.at(7)]),
-    Wx_lns_(model[prefix + keys.at(8)]),
-    Wx_lnb_(model[prefix + keys.at(9)]),
-    U_lns_(model[prefix + keys.at(10)]),
-    U_lnb_(model[prefix + keys.at(11)]),
-    Ux_lns_(model[prefix + keys.at(12)]),
-    Ux_lnb_(model[prefix + keys.at(13)])
-{
-  const_cast<mblas::Tensor&>(Bx2_) = 0.0f;
-  const_cast<mblas::Tensor&>(Bx3_) = 0.0f;
-}
+    W_lns_(model.row(prefix + keys.at(6))),
+    W_lnb_(model.row(prefix + keys.at(7))),
+    Wx_lns_(model.row(prefix + keys.at(8))),
+    Wx_lnb_(model.row(prefix + keys.at(9))),
+    U_lns_(model.row(prefix + keys.at(10))),
+    U_lnb_(model.row(prefix + keys.at(11))),
+    Ux_lns_(model.row(prefix + keys.at(12))),
+    Ux_lnb_(model.row(prefix + keys.at(13))),
+    Wp_(W_, layout),
+    Up_(U_, layout),
+    Wxp_(Wx_, layout),
+    Uxp_(Ux_, layout),
+    WWx_(ConcatUnlessNormalized(model, prefix + keys.at(0) + "+" + prefix + keys.at(3), W_lns_, W_, Wx_)),
+    UUx_(ConcatUnlessNormalized(model, prefix + keys.at(2) + "+" + prefix + keys.at(5), W_lns_, U_, Ux_)),
+    WWxp_(ConcatUnlessNormalized(W_lns_, Wp_, Wxp_)),
+    UUxp_(ConcatUnlessNormalized(W_lns_, Up_, Uxp_))
+{}
 
 //////////////////////////////////////////////////////////////////////////////
 
 Weights::DecInit::DecInit(const NpzConverter& model)
   : Wi_(model["ff_state_W"]),
     Bi_(model("ff_state_b", true)),
-    lns_(model["ff_state_ln_s"]),
-    lnb_(model["ff_state_ln_b"])
+    lns_(model.row("ff_state_ln_s")),
+    lnb_(model.row("ff_state_ln_b"))
 {}
 
 
-Weights::DecGRU2::DecGRU2(const NpzConverter& model, std::string prefix, std::vector<std::string> keys)
+Weights::DecGRU2::DecGRU2(const NpzConverter& model, std::string prefix, std::vector<std::string> keys,
+                          mblas::WeightLayout layout)
   : W_(model[prefix + keys.at(0)]),  // Wc
     B_(1, W_.dim(1)),
     U_(model[prefix + keys.at(1)]),  // U_nl
@@ -109,33 +142,39 @@ Weights::DecGRU2::DecGRU2(const NpzConverter& model, std::string prefix, std::ve
     Bx1_(1, Wx_.dim(1)),
     Ux_(model[prefix + keys.at(4)]),  // Ux_nl
     Bx2_(model(prefix + keys.at(5), true)),  // bx_nl
-    W_lns_(model[prefix + keys.at(6)]),  // Wc_lns
-    W_lnb_(model[prefix + keys.at(7)]),  // Wc_nlb
-    Wx_lns_(model[prefix + keys.at(8)]),  // Wcx_lns
-    Wx_lnb_(model[prefix + keys.at(9)]),  // Wcx_lnb
-    U_lns_(model[prefix + keys.at(10)]),  // U_nl_lns
-    U_lnb_(model[prefix + keys.at(11)]),  // U_nl_lnb
-    Ux_lns_(model[prefix + keys.at(12)]),  // Ux_nl_lns
-    Ux_lnb_(model[prefix + keys.at(13)])  // Ux_nl_lnb
-
-{
-  const_cast<mblas::Tensor&>(B_) = 0.0f;
-  const_cast<mblas::Tensor&>(Bx1_) = 0.0f;
-}
+    W_lns_(model.row(prefix + keys.at(6))),  // Wc_lns
+    W_lnb_(model.row(prefix + keys.at(7))),  // Wc_nlb
+    Wx_lns_(model.row(prefix + keys.at(8))),  // Wcx_lns
+    Wx_lnb_(model.row(prefix + keys.at(9))),  // Wcx_lnb
+    U_lns_(model.row(prefix + keys.at(10))),  // U_nl_lns
+    U_lnb_(model.row(prefix + keys.at(11))),  // U_nl_lnb
+    Ux_lns_(model.row(prefix + keys.at(12))),  // Ux_nl_lns
+    Ux_lnb_(model.row(prefix + keys.at(13))),  // Ux_nl_lnb
+    Wp_(W_, layout),
+    Up_(U_, layout),
+    Wxp_(Wx_, layout),
+    Uxp_(Ux_, layout),
+    WWx_(ConcatUnlessNormalized(model, prefix + keys.at(0) + "+" + prefix + keys.at(3), W_lns_, W_, Wx_)),
+    UUx_(ConcatUnlessNormalized(model, prefix + keys.at(1) + "+" + prefix + keys.at(4), W_lns_, U_, Ux_)),
+    WWxp_(ConcatUnlessNormalized(W_lns_, Wp_, Wxp_)),
+    UUxp_(ConcatUnlessNormalized(W_lns_, Up_, Uxp_))
+{}
 
-Weights::DecAttention::DecAttention(const NpzConverter& model)
+Weights::DecAttention::DecAttention(const NpzConverter& model, mblas::WeightLayout layout)
   : V_(model("decoder_U_att", true)),
     W_(model["decoder_W_comb_att"]),
     B_(model("decoder_b_att", true)),
     U_(model["decoder_Wc_att"]),
     C_(model["decoder_c_tt"]),
-    Wc_att_lns_(model["decoder_Wc_att_lns"]),
-    Wc_att_lnb_(model["decoder_Wc_att_lnb"]),
-    W_comb_lns_(model["decoder_W_comb_att_lns"]),
-    W_comb_lnb_(model["decoder_W_comb_att_lnb"])
+    Wc_att_lns_(model.row("decoder_Wc_att_lns")),
+    Wc_att_lnb_(model.row("decoder_Wc_att_lnb")),
+    W_comb_lns_(model.row("decoder_W_comb_att_lns")),
+    W_comb_lnb_(model.row("decoder_W_comb_att_lnb")),
+    Wp_(W_, layout)
 {}
 
-Weights::DecSoftmax::DecSoftmax(const NpzConverter& model)
+Weights::DecSoftmax::DecSoftmax(const NpzConverter& model, mblas::WeightLayout layout,
+                                bool vocabMajor)
   : W1_(model["ff_logit_lstm_W"]),
     B1_(model("ff_logit_lstm_b", true)),
     W2_(model["ff_logit_prev_W"]),
@@ -146,36 +185,42 @@ Weights::DecSoftmax::DecSoftmax(const NpzConverter& model)
                               std::make_pair(std::string("Wemb_dec"), true),
                               std::make_pair(std::string("Wemb"), true)})),
     B4_(model("ff_logit_b", true)),
-    lns_1_(model["ff_logit_lstm_ln_s"]),
-    lns_2_(model["ff_logit_prev_ln_s"]),
-    lns_3_(model["ff_logit_ctx_ln_s"]),
-    lnb_1_(model["ff_logit_lstm_ln_b"]),
-    lnb_2_(model["ff_logit_prev_ln_b"]),
-    lnb_3_(model["ff_logit_ctx_ln_b"])
+    lns_1_(model.row("ff_logit_lstm_ln_s")),
+    lns_2_(model.row("ff_logit_prev_ln_s")),
+    lns_3_(model.row("ff_logit_ctx_ln_s")),
+    lnb_1_(model.row("ff_logit_lstm_ln_b")),
+    lnb_2_(model.row("ff_logit_prev_ln_b")),
+    lnb_3_(model.row("ff_logit_ctx_ln_b")),
+    W1p_(W1_, layout),
+    W2p_(W2_, layout),
+    W3p_(W3_, layout),
+    W4p_(W4_, layout),
+    W4T_(vocabMajor ? mblas::Transpose<mblas::Tensor>(W4_) : mblas::Tensor())
 {}
 
 //////////////////////////////////////////////////////////////////////////////
 
-Weights::Weights(const NpzConverter& model, size_t)
+Weights::Weights(const NpzConverter& model, size_t, mblas::WeightLayout layout,
+                 bool vocabMajorOutput)
   : encEmbeddings_(model, "Wemb"),
     decEmbeddings_(model, std::vector<std::pair<std::string, bool>>(
           {std::make_pair(std::string("Wemb_dec"), false),
            std::make_pair(std::string("Wemb"), false)})),
     encForwardGRU_(model, "encoder_", {"W", "b", "U", "Wx", "bx", "Ux", "W_lns", "W_lnb", "Wx_lns",
-                                       "Wx_lnb", "U_lns", "U_lnb", "Ux_lns", "Ux_lnb" }),
+                                       "Wx_lnb", "U_lns", "U_lnb", "Ux_lns", "Ux_lnb" }, layout),
     encBackwardGRU_(model, "encoder_r_", {"W", "b", "U", "Wx", "bx", "Ux", "W_lns", "W_lnb",
-                                          "Wx_lns", "Wx_lnb", "U_lns", "U_lnb", "Ux_lns", "Ux_lnb" }),
+                                          "Wx_lns", "Wx_lnb", "U_lns", "U_lnb", "Ux_lns", "Ux_lnb" }, layout),
     decInit_(model),
     decGru1_(model, "decoder_", {"W", "b", "U", "Wx", "bx", "Ux", "W_lns", "W_lnb", "Wx_lns",
-                                 "Wx_lnb", "U_lns", "U_lnb", "Ux_lns", "Ux_lnb" }),
+                                 "Wx_lnb", "U_lns", "U_lnb", "Ux_lns", "Ux_lnb" }, layout),
     decGru2_(model, "decoder_", {"Wc", "U_nl", "b_nl", "Wcx", "Ux_nl", "bx_nl", "Wc_lns", "Wc_lnb",
                                  "Wcx_lns", "Wcx_lnb", "U_nl_lns", "U_nl_lnb", "Ux_nl_lns",
-                                 "Ux_nl_lnb"}),
-    decAttention_(model),
-    decSoftmax_(model),
-    encForwardTransition_(model, Weights::Transition::TransitionType::Encoder, "encoder_"),
-    encBackwardTransition_(model,Weights::Transition::TransitionType::Encoder, "encoder_r_"),
-    decTransition_(model, Weights::Transition::TransitionType::Decoder, "decoder_", "_nl")
+                                 "Ux_nl_lnb"}, layout),
+    decAttention_(model, layout),
+    decSoftmax_(model, layout, vocabMajorOutput),
+    encForwardTransition_(model, Weights::Transition::TransitionType::Encoder, "encoder_", "", layout),
+    encBackwardTransition_(model,Weights::Transition::TransitionType::Encoder, "encoder_r_", "", layout),
+    decTransition_(model, Weights::Transition::TransitionType::Decoder, "decoder_", "_nl", layout)
 {}
 
 }  // namespace Nematus
@@ -7,6 +7,7 @@
 #include "cpu/npz_converter.h"
 
 #include "cpu/mblas/tensor.h"
+#include "cpu/mblas/packed.h"
 
 namespace amunmt {
 namespace CPU {
@@ -18,7 +19,7 @@ struct Weights {
       enum class TransitionType {Encoder, Decoder};
 
       Transition(const NpzConverter& model, TransitionType type, std::string prefix,
-                 std::string infix="");
+                 std::string infix="", mblas::WeightLayout layout=mblas::WeightLayout::Blaze);
 
     static int findTransitionDepth(const NpzConverter& model, std::string prefix, std::string infix);
 
@@ -35,118 +36,162 @@ struct Weights {
       TransitionType type_;
 
     public:
-      std::vector<mblas::Tensor> B_;
-      std::vector<mblas::Tensor> Bx1_;
-      std::vector<mblas::Tensor> Bx2_;
-      std::vector<mblas::Tensor> U_;
-      std::vector<mblas::Tensor> Ux_;
-
-      std::vector<mblas::Tensor> U_lns_;
-      std::vector<mblas::Tensor> U_lnb_;
-      std::vector<mblas::Tensor> Ux_lns_;
-      std::vector<mblas::Tensor> Ux_lnb_;
-
+      std::vector<mblas::WeightTensor> B_;
+      std::vector<mblas::WeightTensor> Bx1_;
+      std::vector<mblas::WeightTensor> Bx2_;
+      std::vector<mblas::WeightTensor> U_;
+      std::vector<mblas::WeightTensor> Ux_;
+
+      std::vector<mblas::WeightTensor> U_lns_;
+      std::vector<mblas::WeightTensor> U_lnb_;
+      std::vector<mblas::WeightTensor> Ux_lns_;
+      std::vector<mblas::WeightTensor> Ux_lnb_;
+
+      // copies of U_ and Ux_ in the weight layout, empty for Blaze
+      std::vector<mblas::PackedTensor> Up_;
+      std::vector<mblas::PackedTensor> Uxp_;
   };
 
   struct Embeddings {
     Embeddings(const NpzConverter& model, const std::string &key);
     Embeddings(const NpzConverter& model, const std::vector<std::pair<std::string, bool>> keys);
 
-    const mblas::Tensor E_;
+    const mblas::WeightTensor E_;
   };
 
   struct GRU {
-    GRU(const NpzConverter& model, std::string prefix, std::vector<std::string> keys);
-
-    const mblas::Tensor W_;
-    const mblas::Tensor B_;
-    const mblas::Tensor U_;
-    const mblas::Tensor Wx_;
-    const mblas::Tensor Bx1_;
-    const mblas::Tensor Bx2_;
-    const mblas::Tensor Bx3_;
-    const mblas::Tensor Ux_;
-
-    const mblas::Tensor W_lns_;
-    const mblas::Tensor W_lnb_;
-    const mblas::Tensor Wx_lns_;
-    const mblas::Tensor Wx_lnb_;
-    const mblas::Tensor U_lns_;
-    const mblas::Tensor U_lnb_;
-    const mblas::Tensor Ux_lns_;
-    const mblas::Tensor Ux_lnb_;
+    GRU(const NpzConverter& model, std::string prefix, std::vector<std::string> keys,
+        mblas::WeightLayout layout);
+
+    const mblas::WeightTensor W_;
+    const mblas::WeightTensor B_;
+    const mblas::WeightTensor U_;
+    const mblas::WeightTensor Wx_;
+    const mblas::WeightTensor Bx1_;
+    const mblas::WeightTensor Bx2_;
+    const mblas::WeightTensor Bx3_;
+    const mblas::WeightTensor Ux_;
+
+    const mblas::WeightTensor W_lns_;
+    const mblas::WeightTensor W_lnb_;
+    const mblas::WeightTensor Wx_lns_;
+    const mblas::WeightTensor Wx_lnb_;
+    const mblas::WeightTensor U_lns_;
+    const mblas::WeightTensor U_lnb_;
+    const mblas::WeightTensor Ux_lns_;
+    const mblas::WeightTensor Ux_lnb_;
+
+    const mblas::PackedTensor Wp_;
+    const mblas::PackedTensor Up_;
+    const mblas::PackedTensor Wxp_;
+    const mblas::PackedTensor Uxp_;
+
+    // [W_ Wx_] and [U_ Ux_] of models without layer normalization, empty
+    // otherwise. The GRUs of all threads multiply by these.
+    const mblas::WeightTensor WWx_;
+    const mblas::WeightTensor UUx_;
+    const mblas::PackedTensor WWxp_;
+    const mblas::PackedTensor UUxp_;
   };
 
   struct DecInit {
     DecInit(const NpzConverter& model);
 
-    const mblas::Tensor Wi_;
-    const mblas::Tensor Bi_;
-    const mblas::Tensor lns_;
-    const mblas::Tensor lnb_;
+    const mblas::WeightTensor Wi_;
+    const mblas::WeightTensor Bi_;
+    const mblas::WeightTensor lns_;
+    const mblas::WeightTensor lnb_;
   };
 
   struct DecGRU2 {
-    DecGRU2(const NpzConverter& model, std::string prefix, std::vector<std::string> keys);
-
-    const mblas::Tensor W_;
-    const mblas::Tensor B_;
-    const mblas::Tensor U_;
-    const mblas::Tensor Wx_;
-    const mblas::Tensor Bx3_;
-    const mblas::Tensor Bx2_;
-    const mblas::Tensor Bx1_;
-    const mblas::Tensor Ux_;
-
-    const mblas::Tensor W_lns_;
-    const mblas::Tensor W_lnb_;
-    const mblas::Tensor Wx_lns_;
-    const mblas::Tensor Wx_lnb_;
-    const mblas::Tensor U_lns_;
-    const mblas::Tensor U_lnb_;
-    const mblas::Tensor Ux_lns_;
-    const mblas::Tensor Ux_lnb_;
+    DecGRU2(const NpzConverter& model, std::string prefix, std::vector<std::string> keys,
+            mblas::WeightLayout layout);
+
+    const mblas::WeightTensor W_;
+    const mblas::WeightTensor B_;
+    const mblas::WeightTensor U_;
+    const mblas::WeightTensor Wx_;
+    const mblas::WeightTensor Bx3_;
+    const mblas::WeightTensor Bx2_;
+    const mblas::WeightTensor Bx1_;
+    const mblas::WeightTensor Ux_;
+
+    const mblas::WeightTensor W_lns_;
+    const mblas::WeightTensor W_lnb_;
+    const mblas::WeightTensor Wx_lns_;
+    const mblas::WeightTensor Wx_lnb_;
+    const mblas::WeightTensor U_lns_;
+    const mblas::WeightTensor U_lnb_;
+    const mblas::WeightTensor Ux_lns_;
+    const mblas::WeightTensor Ux_lnb_;
+
+    const mblas::PackedTensor Wp_;
+    const mblas::PackedTensor Up_;
+    const mblas::PackedTensor Wxp_;
+    const mblas::PackedTensor Uxp_;
+
+    // [W_ Wx_] and [U_ Ux_] of models without layer normalization, empty
+    // otherwise. The GRUs of all threads multiply by these.
+    const mblas::WeightTensor WWx_;
+    const mblas::WeightTensor UUx_;
+    const mblas::PackedTensor WWxp_;
+    const mblas::PackedTensor UUxp_;
   };
 
   struct DecAttention {
-    DecAttention(const NpzConverter& model);
-
-    const mblas::Tensor V_;
-    const mblas::Tensor W_;
-    const mblas::Tensor B_;
-    const mblas::Tensor U_;
-    const mblas::Tensor C_;
-    const mblas::Tensor Wc_att_lns_;
-    const mblas::Tensor Wc_att_lnb_;
-    const mblas::Tensor W_comb_lns_;
-    const mblas::Tensor W_comb_lnb_;
+    DecAttention(const NpzConverter& model, mblas::WeightLayout layout);
+
+    const mblas::WeightTensor V_;
+    const mblas::WeightTensor W_;
+    const mblas::WeightTensor B_;
+    const mblas::WeightTensor U_;
+    const mblas::WeightTensor C_;
+    const mblas::WeightTensor Wc_att_lns_;
+    const mblas::WeightTensor Wc_att_lnb_;
+    const mblas::WeightTensor W_comb_lns_;
+    const mblas::WeightTensor W_comb_lnb_;
+
+    const mblas::PackedTensor Wp_;
   };
 
   struct DecSoftmax {
-    DecSoftmax(const NpzConverter& model);
-
-    const mblas::Tensor W1_;
-    const mblas::Tensor B1_;
-    const mblas::Tensor W2_;
-    const mblas::Tensor B2_;
-    const mblas::Tensor W3_;
-    const mblas::Tensor B3_;
-    const mblas::Tensor W4_;
-    const mblas::Tensor B4_;
-    const mblas::Tensor lns_1_;
-    const mblas::Tensor lns_2_;
-    const mblas::Tensor lns_3_;
-    const mblas::Tensor lnb_1_;
-    const mblas::Tensor lnb_2_;
-    const mblas::Tensor lnb_3_;
+    DecSoftmax(const NpzConverter& model, mblas::WeightLayout layout, bool vocabMajor);
+
+    const mblas::WeightTensor W1_;
+    const mblas::WeightTensor B1_;
+    const mblas::WeightTensor W2_;
+    const mblas::WeightTensor B2_;
+    const mblas::WeightTensor W3_;
+    const mblas::WeightTensor B3_;
+    const mblas::WeightTensor W4_;
+    const mblas::WeightTensor B4_;
+    const mblas::WeightTensor lns_1_;
+    const mblas::WeightTensor lns_2_;
+    const mblas::WeightTensor lns_3_;
+    const mblas::WeightTensor lnb_1_;
+    const mblas::WeightTensor lnb_2_;
+    const mblas::WeightTensor lnb_3_;
+
+    const mblas::PackedTensor W1p_;
+    const mblas::PackedTensor W2p_;
+    const mblas::PackedTensor W3p_;
+    const mblas::PackedTensor W4p_;
+
+    // vocab-major copy of W4_ for --softmax-filter, empty if not requested
+    const mblas::Tensor W4T_;
   };
 
 
-  Weights(const std::string& npzFile, size_t device = 0)
-    : Weights(NpzConverter(npzFile), device)
+  Weights(const std::string& npzFile, size_t device = 0, mblas::WeightLayout layout = mblas::WeightLayout::Blaze,
+          bool vocabMajorOutput = false)
+    : Weights(NpzConverter(npzFile), device, layout, vocabMajorOutput)
   {}
 
-  Weights(const NpzConverter& model, size_t device = 0);
+  // layout: also keep the matrices used in per-step products in this layout
+  // vocabMajorOutput: also keep the transpose of the output layer, whose
+  // shortlisted rows are gathered faster than the columns of W4_
+  Weights(const NpzConverter& model, size_t device = 0, mblas::WeightLayout layout = mblas::WeightLayout::Blaze,
+          bool vocabMajorOutput = false);
 
   size_t GetDevice() {
     return std::numeric_limits<size_t>::max();
@@ -8,7 +8,7 @@ Transition::Transition(const Weights::Transition& model)
   : w_(model),
     layerNormalization_(false)
 {
-  if (w_.U_lns_.size() > 1 && w_.U_lns_[0].rows() > 1) {
+  if (w_.U_lns_.size() > 1 && w_.U_lns_[0].columns() > 1) {
     layerNormalization_ = true;
   }
 }
@@ -18,8 +18,8 @@ void Transition::GetNextState(mblas::Tensor& state) const
 {
   if (layerNormalization_) {
     for (int i = 0; i < w_.size(); ++i) {
-      Temp_1_ = state * w_.U_[i];
-      Temp_2_ = state * w_.Ux_[i];
+      mblas::Prod(Temp_1_, state, w_.U_[i], w_.Up_[i]);
+      mblas::Prod(Temp_2_, state, w_.Ux_[i], w_.Uxp_[i]);
 
       switch(w_.type()) {
         case Weights::Transition::TransitionType::Encoder:
@@ -30,19 +30,16 @@ void Transition::GetNextState(mblas::Tensor& state) const
           break;
 
         case Weights::Transition::TransitionType::Decoder:
-          mblas::AddBiasVector<mblas::byRow>(Temp_1_, w_.B_[i]);
-          LayerNormalization(Temp_1_, w_.U_lns_[i], w_.U_lnb_[i]);
-
-          mblas::AddBiasVector<mblas::byRow>(Temp_2_, w_.Bx1_[i]);
-          LayerNormalization(Temp_2_, w_.Ux_lns_[i], w_.Ux_lnb_[i]);
+          mblas::AddBiasAndLayerNormalization(Temp_1_, w_.B_[i], w_.U_lns_[i], w_.U_lnb_[i]);
+          mblas::AddBiasAndLayerNormalization(Temp_2_, w_.Bx1_[i], w_.Ux_lns_[i], w_.Ux_lnb_[i]);
           break;
       }
       ElementwiseOps(state, i);
     }
   } else {
     for (int i = 0; i < w_.size(); ++i) {
-      Temp_1_ = state * w_.U_[i];
-      Temp_2_ = state * w_.Ux_[i];
+      mblas::Prod(Temp_1_, state, w_.U_[i], w_.Up_[i]);
+      mblas::Prod(Temp_2_, state, w_.Ux_[i], w_.Uxp_[i]);
       mblas::AddBiasVector<mblas::byRow>(Temp_1_, w_.B_[i]);
       mblas::AddBiasVector<mblas::byRow>(Temp_2_, w_.Bx1_[i]);
       ElementwiseOps(state, i);
@@ -55,24 +52,12 @@ void Transition::ElementwiseOps(mblas::Tensor& state, int idx) const {
   using namespace mblas;
   using namespace blaze;
 
+  // biases B_ and Bx1_ are already added to Temp_1_ and Temp_2_
   for (int j = 0; j < (int)state.dim(0); ++j) {
-    auto rowState = row(state, j);
-    auto rowT   = row(Temp_1_, j);
-    auto rowT2  = row(Temp_2_, j);
-
-    for (int i = 0; i < (int)state.dim(1); ++i) {
-      float ev1 = expapprox(-(rowT[i])); // + w_.B_[idx](0, i)));
-      float r = 1.0f / (1.0f + ev1);
-
-      int k = i + state.dim(1);
-      float ev2 = expapprox(-(rowT[k])); // + w_.B_[idx](0, k)));
-      float u = 1.0f / (1.0f + ev2);
-
-      float hv = w_.Bx2_[idx](0, i);
-      float t2v = rowT2[i]; // + w_.Bx1_[idx](0, i);
-      hv = tanhapprox(hv + r * t2v);
-      rowState[i] = (1.0f - u) * hv + u * rowState[i];
-    }
+    simd::GRUUpdate(&state(j, 0), &state(j, 0),
+                    &Temp_1_(j, 0), nullptr, nullptr,
+                    nullptr, &w_.Bx2_[idx](0, 0),
+                    &Temp_2_(j, 0), nullptr, state.dim(1));
   }
 }
 
@@ -21,7 +21,6 @@ class Transition {
     const Weights::Transition& w_;
 
     // reused to avoid allocation
-    mutable mblas::Tensor UUx_;
     mutable mblas::Tensor RUH_;
     mutable mblas::Tensor RUH_1_;
     mutable mblas::Tensor RUH_2_;
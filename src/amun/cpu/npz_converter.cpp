@@ -0,0 +1,257 @@
+#include "cpu/npz_converter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <boost/timer/timer.hpp>
+
+#include "common/exception.h"
+#include "common/logging.h"
+
+namespace amunmt {
+namespace CPU {
+
+const char NpzConverter::MAGIC[8] = {'A', 'M', 'U', 'N', 'M', 'D', 'L', '\0'};
+const uint32_t NpzConverter::VERSION;
+
+namespace {
+
+// alignment of every matrix in the converted format
+const uint64_t ALIGNMENT = 64;
+
+}
+
+NpzConverter::NpzConverter(const std::string& file, unsigned numThreads)
+{
+  if (!IsConverted(file)) {
+    boost::timer::cpu_timer timer;
+    cnpy::npz_t model = cnpy::npz_load(file);
+    std::string readTime = timer.format(2, "%ws");
+
+    timer.start();
+    Convert(model, numThreads ? numThreads : std::max(std::thread::hardware_concurrency(), 1u));
+    model.destruct();
+    LOG(info)->info("Read {} in {}, converted {} arrays in {}",
+                    file, readTime, arrays_.size(), timer.format(2, "%ws"));
+    return;
+  }
+
+  LOG(info)->info("Mapping converted model {}", file);
+  mapped_.reset(new MappedFile(file));
+
+  Header header;
+  amunmt_UTIL_THROW_IF2(mapped_->size() < sizeof(header), "Converted model " << file << " is truncated");
+  std::memcpy(&header, mapped_->data(), sizeof(header));
+  amunmt_UTIL_THROW_IF2(header.version != VERSION,
+                        "Converted model " << file << " has version " << header.version
+                        << ", expected " << VERSION);
+  amunmt_UTIL_THROW_IF2(mapped_->size() < sizeof(header) + header.numMatrices * sizeof(Entry),
+                        "Converted model " << file << " is truncated");
+
+  const Entry* entries = reinterpret_cast<const Entry*>(mapped_->data() + sizeof(header));
+  for (uint32_t i = 0; i < header.numMatrices; ++i) {
+    const Entry& entry = entries[i];
+    amunmt_UTIL_THROW_IF2(entry.offset % ALIGNMENT != 0
+                          || entry.spacing < entry.columns
+                          || entry.spacing % mblas::WeightTensor::PADDING != 0
+                          || entry.offset + uint64_t(entry.rows) * entry.spacing * sizeof(float)
+                             > mapped_->size(),
+                          "Converted model " << file << " is corrupt");
+    entries_[std::string(entry.name, strnlen(entry.name, sizeof(entry.name)))] = &entry;
+  }
+}
+
+NpzConverter::~NpzConverter() {}
+
+void NpzConverter::Convert(const cnpy::npz_t& model, unsigned numThreads) {
+  std::vector<std::pair<std::string, const cnpy::NpyArray*>> arrays;
+  for (const auto& array : model) {
+    // None saved by numpy.savez()
+    if (array.second.word_size > 0) {
+      arrays.emplace_back(array.first, &array.second);
+    }
+  }
+
+  std::vector<mblas::WeightTensor> converted(arrays.size());
+  std::atomic<size_t> next(0);
+  auto convert = [&]() {
+    for (size_t i = next++; i < arrays.size(); i = next++) {
+      NpyMatrixWrapper np(*arrays[i].second);
+      converted[i] = mblas::WeightTensor(BlazeWrapper(np.data(), np.size1(), np.size2()));
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < std::min<size_t>(numThreads, arrays.size()); ++i) {
+    threads.emplace_back(convert);
+  }
+  convert();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  for (size_t i = 0; i < arrays.size(); ++i) {
+    arrays_[arrays[i].first] = std::move(converted[i]);
+  }
+}
+
+bool NpzConverter::IsConverted(const std::string& file) {
+  char magic[sizeof(MAGIC)];
+  std::ifstream stream(file, std::ios::binary);
+  return stream.read(magic, sizeof(magic)) && std::equal(magic, magic + sizeof(magic), MAGIC);
+}
+
+bool NpzConverter::has(std::string key) const {
+  if (mapped_) {
+    return entries_.count(Name(key, false)) || entries_.count(Name(key, true));
+  }
+  return arrays_.count(key);
+}
+
+void NpzConverter::Destruct() {
+  arrays_.clear();
+}
+
+std::string NpzConverter::Name(const std::string& key, bool transpose) {
+  return transpose ? key + ":T" : key;
+}
+
+mblas::WeightTensor NpzConverter::Map(const Entry& entry) const {
+  return mblas::WeightTensor(reinterpret_cast<const float*>(mapped_->data() + entry.offset),
+                             entry.rows, entry.columns, entry.spacing, mapped_);
+}
+
+bool NpzConverter::Get(const std::string& key, bool transpose, mblas::WeightTensor& matrix) const {
+  std::string name = Name(key, transpose);
+  if (mapped_) {
+    auto it = entries_.find(name);
+    if (it == entries_.end()) {
+      return false;
+    }
+    matrix = Map(*it->second);
+  } else {
+    auto it = arrays_.find(key);
+    if (it == arrays_.end()) {
+      return false;
+    }
+    if (transpose) {
+      matrix = mblas::WeightTensor(blaze::trans(it->second));
+    } else {
+      matrix = it->second;
+    }
+  }
+  returned_[name] = matrix;
+  return true;
+}
+
+mblas::WeightTensor NpzConverter::operator[](const std::string& key) const {
+  mblas::WeightTensor matrix;
+  if (!Get(key, false, matrix)) {
+    if (key.find("gamma") == std::string::npos) {
+      std::cerr << "Missing " << key << std::endl;
+    }
+  }
+  return matrix;
+}
+
+mblas::WeightTensor NpzConverter::row(const std::string& key) const {
+  bool transpose;
+  if (mapped_) {
+    transpose = entries_.count(Name(key, true));
+  } else {
+    auto it = arrays_.find(key);
+    transpose = it != arrays_.end() && it->second.columns() == 1;
+  }
+
+  mblas::WeightTensor matrix;
+  if (!Get(key, transpose, matrix)) {
+    if (key.find("gamma") == std::string::npos) {
+      std::cerr << "Missing " << key << std::endl;
+    }
+  }
+  return matrix;
+}
+
+mblas::WeightTensor NpzConverter::getFirstOfMany(const std::vector<std::pair<std::string, bool>> keys) const {
+  mblas::WeightTensor matrix;
+  for (auto key : keys) {
+    if (Get(key.first, key.second, matrix)) {
+      return matrix;
+    }
+  }
+  std::cerr << "Matrix not found: " << keys[0].first << "\n";
+  return matrix;
+}
+
+mblas::WeightTensor NpzConverter::operator()(const std::string& key,
+                                             bool transpose) const {
+  mblas::WeightTensor matrix;
+  if (!Get(key, transpose, matrix)) {
+    std::cerr << "Missing " << key << std::endl;
+  }
+  return matrix;
+}
+
+mblas::WeightTensor NpzConverter::derived(const std::string& name,
+                                          const std::function<mblas::WeightTensor()>& compute) const {
+  mblas::WeightTensor matrix;
+  auto it = entries_.find(name);
+  if (it != entries_.end()) {
+    matrix = Map(*it->second);
+  } else {
+    matrix = compute();
+  }
+  returned_[name] = matrix;
+  return matrix;
+}
+
+void NpzConverter::Save(const std::string& file) const {
+  Header header;
+  std::copy(MAGIC, MAGIC + sizeof(MAGIC), header.magic);
+  header.version = VERSION;
+  header.numMatrices = returned_.size();
+
+  std::vector<Entry> entries;
+  uint64_t offset = sizeof(header) + returned_.size() * sizeof(Entry);
+  for (const auto& returned : returned_) {
+    const std::string& name = returned.first;
+    const mblas::WeightTensor& matrix = returned.second;
+    amunmt_UTIL_THROW_IF2(name.size() >= sizeof(Entry::name), "Matrix name " << name << " is too long");
+
+    Entry entry;
+    std::memset(&entry, 0, sizeof(entry));
+    std::copy(name.begin(), name.end(), entry.name);
+    entry.rows = matrix.rows();
+    entry.columns = matrix.columns();
+    entry.spacing = mblas::WeightTensor::Spacing(matrix.columns());
+    offset = (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    entry.offset = offset;
+    offset += uint64_t(entry.rows) * entry.spacing * sizeof(float);
+    entries.push_back(entry);
+  }
+
+  std::ofstream stream(file, std::ios::binary);
+  stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  stream.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(Entry));
+
+  auto entry = entries.begin();
+  for (const auto& returned : returned_) {
+    const mblas::WeightTensor& matrix = returned.second;
+    std::vector<float> row(entry->spacing, 0.0f);
+    stream.seekp(entry->offset);
+    for (unsigned i = 0; i < entry->rows; ++i) {
+      for (unsigned j = 0; j < entry->columns; ++j) {
+        row[j] = matrix(i, j);
+      }
+      stream.write(reinterpret_cast<const char*>(row.data()), row.size() * sizeof(float));
+    }
+    ++entry;
+  }
+  amunmt_UTIL_THROW_IF2(!stream, "Cannot write " << file);
+}
+
+}
+}
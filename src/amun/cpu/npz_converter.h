@@ -1,11 +1,22 @@
 #pragma once
 
+#include <functional>
+#include <map>
+#include <unordered_map>
+
 #include "cnpy/cnpy.h"
+#include "common/mapped_file.h"
 #include "mblas/tensor.h"
 
 namespace amunmt {
 namespace CPU {
 
+// Reads the matrices of a model, either from an .npz file or from a model
+// converted by amun_model2bin. The converted format stores every matrix as
+// the Weights request it, already transposed and with aligned, padded rows,
+// so it is mapped into memory and wrapped without copying. The arrays of an
+// .npz file are converted on numThreads threads when it is read, or on all
+// hardware threads if it is 0.
 class NpzConverter {
   private:
     class NpyMatrixWrapper {
@@ -45,93 +56,79 @@ class NpzConverter {
     typedef blaze::CustomMatrix<float, blaze::unaligned,
       blaze::unpadded, blaze::rowMajor> BlazeWrapper;
 
-    bool has(std::string key) const {
-      auto it = model_.find(key);
-      return (it != model_.end());
-    }
-
-
-    NpzConverter(const std::string& file)
-      : model_(cnpy::npz_load(file)),
-        destructed_(false) {
-      }
-
-    ~NpzConverter() {
-      if(!destructed_)
-        model_.destruct();
-    }
-
-    void Destruct() {
-      model_.destruct();
-      destructed_ = true;
-    }
-
-    mblas::Tensor operator[](const std::string& key) const {
-      BlazeWrapper matrix;
-      auto it = model_.find(key);
-      if(it != model_.end()) {
-        NpyMatrixWrapper np(it->second);
-        matrix = BlazeWrapper(np.data(), np.size1(), np.size2());
-      }
-      else {
-        if (key.find("gamma") == std::string::npos) {
-          std::cerr << "Missing " << key << std::endl;
-        }
-      }
-
-      mblas::Tensor ret;
-      ret = matrix;
-      return std::move(ret);
-    }
-
-    mblas::Tensor getFirstOfMany(const std::vector<std::pair<std::string, bool>> keys) const {
-      BlazeWrapper matrix;
-      for (auto key : keys) {
-        auto it = model_.find(key.first);
-        if(it != model_.end()) {
-          NpyMatrixWrapper np(it->second);
-          matrix = BlazeWrapper(np.data(), np.size1(), np.size2());
-          mblas::Tensor ret;
-          if (key.second) {
-            const auto matrix2 = blaze::trans(matrix);
-            ret = matrix2;
-          } else {
-            ret = matrix;
-          }
-          return std::move(ret);
-        }
-      }
-      std::cerr << "Matrix not found: " << keys[0].first << "\n";
-
-      mblas::Tensor ret;
-      return std::move(ret);
-    }
-
-    mblas::Tensor operator()(const std::string& key,
-                                   bool transpose) const {
-      BlazeWrapper matrix;
-      auto it = model_.find(key);
-      if(it != model_.end()) {
-        NpyMatrixWrapper np(it->second);
-        matrix = BlazeWrapper(np.data(), np.size1(), np.size2());
-      } else {
-          std::cerr << "Missing " << key << std::endl;
-      }
-      mblas::Tensor ret;
-      if (transpose) {
-        const auto matrix2 = blaze::trans(matrix);
-        ret = matrix2;
-      } else {
-        ret = matrix;
-      }
-      return std::move(ret);
-    }
+    NpzConverter(const std::string& file, unsigned numThreads = 0);
+
+    ~NpzConverter();
+
+    NpzConverter(const NpzConverter&) = delete;
+
+    // whether file starts like a model written by Save
+    static bool IsConverted(const std::string& file);
+
+    bool has(std::string key) const;
+
+    // releases the arrays of an .npz file not used by any matrix returned
+    void Destruct();
+
+    mblas::WeightTensor operator[](const std::string& key) const;
+
+    // a vector as a 1 x n row, whether the model stores it as a row or as a
+    // column
+    mblas::WeightTensor row(const std::string& key) const;
+
+    mblas::WeightTensor getFirstOfMany(const std::vector<std::pair<std::string, bool>> keys) const;
+
+    mblas::WeightTensor operator()(const std::string& key,
+                                   bool transpose) const;
+
+    // a matrix the Weights derive from others at load time, e.g. a
+    // concatenation. It is computed unless the converted model stores it.
+    mblas::WeightTensor derived(const std::string& name,
+                                const std::function<mblas::WeightTensor()>& compute) const;
+
+    // writes all matrices returned so far in the converted format
+    void Save(const std::string& file) const;
 
   private:
-    cnpy::npz_t model_;
-    bool destructed_;
+    struct Header {
+      char magic[8];
+      uint32_t version;
+      uint32_t numMatrices;
+    };
+
+    struct Entry {
+      char name[112];
+      uint32_t rows;
+      uint32_t columns;
+      uint32_t spacing;
+      uint32_t reserved;
+      uint64_t offset;
+    };
+
+    static const char MAGIC[8];
+    static const uint32_t VERSION = 1;
+
+    // name of key in the converted format
+    static std::string Name(const std::string& key, bool transpose);
+
+    // view of the matrix of entry in the mapped file
+    mblas::WeightTensor Map(const Entry& entry) const;
+
+    // false if the model has no key
+    bool Get(const std::string& key, bool transpose, mblas::WeightTensor& matrix) const;
+
+    // converts the arrays of model into arrays_ on numThreads threads
+    void Convert(const cnpy::npz_t& model, unsigned numThreads);
+
+    // arrays of an .npz file
+    std::unordered_map<std::string, mblas::WeightTensor> arrays_;
+
+    MappedFilePtr mapped_;
+    std::unordered_map<std::string, const Entry*> entries_;
+
+    // by Name, for Save
+    mutable std::map<std::string, mblas::WeightTensor> returned_;
 };
 
 }
 }
-
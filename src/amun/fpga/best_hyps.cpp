@@ -41,7 +41,8 @@ void BestHyps::CalcBeam(
     const std::vector<ScorerPtr>& scorers,
     const Words& filterIndices,
     std::vector<Beam>& beams,
-    std::vector<uint>& beamSizes
+    std::vector<uint>& beamSizes,
+    bool isFirst
     )
 {
   /*
@@ -58,8 +59,6 @@ void BestHyps::CalcBeam(
   Costs.Set(vCosts);
   //cerr << "Costs=" << Costs.Debug(1) << endl;
 
-  const bool isFirst = (vCosts[0] == 0.0f) ? true : false;
-
   float weight = weights_.at(scorers[0]->GetName());
 
   BroadcastVecColumnAddWeighted(Probs, weight, Costs);
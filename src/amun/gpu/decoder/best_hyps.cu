@@ -70,7 +70,8 @@ void  BestHyps::CalcBeam(
     const std::vector<ScorerPtr>& scorers,
     const Words& filterIndices,
     std::vector<Beam>& beams,
-    std::vector<unsigned>& beamSizes)
+    std::vector<unsigned>& beamSizes,
+    bool isFirst)
 {
   BEGIN_TIMER("CalcBeam");
 
@@ -94,8 +95,6 @@ void  BestHyps::CalcBeam(
   std::vector<float> bestCosts;
   std::vector<unsigned> bestKeys;
 
-  const bool isFirst = (vCosts[0] == 0.0f) ? true : false;
-
   if (god_.UseFusedSoftmax()) {
     const mblas::Tensor& b4 = *static_cast<const mblas::Tensor*>(scorers[0]->GetBias());
     mblas::Vector<NthOutBatch> &nBest = *static_cast<mblas::Vector<NthOutBatch>*>(scorers[0]->GetNBest());
@@ -39,7 +39,8 @@ class BestHyps : public BaseBestHyps
         const std::vector<ScorerPtr>& scorers,
         const Words& filterIndices,
         std::vector<Beam>& beams,
-        std::vector<unsigned>& beamSizes);
+        std::vector<unsigned>& beamSizes,
+        bool isFirst);
 
   private:
     std::unique_ptr<NthElement> nthElement_;